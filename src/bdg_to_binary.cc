@@ -0,0 +1,107 @@
+//***************************************************************************
+//
+// Program to convert a bedGraph profile into the binary columnar format,
+// which all of the tools can read in place of the text file.
+//
+//***************************************************************************
+
+#include<iostream>
+#include<cstdlib>
+#include<string>
+#include<fstream>
+
+#include "bedfiles.h"
+#include "binprofile.h"
+#include "runreport.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<5) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./bdg_to_binary -i inputfile -o outputfile [--profile report]"<<endl;
+    cout<<"where       inputfile    is a bedGraph file, e.g. a normalized pile-up file."<<endl;
+    cout<<"            outfile      is a file name for the binary output."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<endl;
+    cout<<"The output file can be used in the inputslist of any of the tools instead of the bedGraph."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string inputfile,
+    outputfile,
+    profilefile;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-i" ) {
+      // input file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-i)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      inputfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-o" ) {
+      // output file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-o)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      outputfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  if ( !profilefile.empty() && !run_report.open(profilefile,"bdg_to_binary",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  ifstream inf;
+
+  // Test input file
+  inf.open( inputfile.c_str() );
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<inputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  inf.close();
+
+  // Test output file
+  inf.open( outputfile.c_str() );
+  if ( inf.good() ) {
+    cerr<<" ERROR : File "<<outputfile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+  inf.close();
+
+  run_report.phase("convert");
+  if ( !write_binprofile(inputfile,outputfile) ) {
+    cerr<<" ERROR : Failed to write "<<outputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
+
+}
@@ -4,19 +4,68 @@
 //
 //***************************************************************************
 
+#include<iostream>
 #include<string>
 #include<sstream>
+#include<fstream>
+#include<cstring>
+#include<cstdlib>
+#include<algorithm>
+#include<cmath>
+#include<cstdio>
+#include<stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "bedfiles.h"
+#include "binprofile.h"
+#include "bigwig.h"
+#include "bgzf.h"
+#include "tabix.h"
+#include "fastparse.h"
 
 using namespace std;
 
 
+bool operator==(const string &a, const strview &b) {
+  return a.size()==b.len && a.compare(0,a.size(),b.ptr,b.len)==0;
+}
+
+bool operator==(const strview &a, const string &b) { return b==a; }
+bool operator!=(const string &a, const strview &b) { return !(a==b); }
+bool operator!=(const strview &a, const string &b) { return !(b==a); }
+
+
+chromdict chrom_ids;
+
+uint32_t chromdict::id(const string &chrom) {
+  // the id of a name, giving it the next one if it is new
+  lock_guard<mutex> guard(lock);
+  unordered_map<string,uint32_t>::const_iterator it = ids.find(chrom);
+  if ( it!=ids.end() ) {
+    return it->second;
+  }
+  uint32_t next = names.size();
+  ids[chrom] = next;
+  names.push_back(chrom);
+  return next;
+}
+
+const string& chromdict::name(const uint32_t &chromid) const {
+  lock_guard<mutex> guard(lock);
+  return names[chromid];
+}
+
+
+
 bedline::bedline(const string &line) : set_midpoint(false) {
   // Convert a string into a bedline object
   stringstream sline;
   sline.str(line);
   sline>>chrom>>start>>end>>name>>strand;
+  chromid = chrom_ids.id(chrom);
   if (strand == "+") {
     istrand=1;
   } else if (strand == "-") {
@@ -29,8 +78,8 @@ bedline::bedline(const string &line) : set_midpoint(false) {
 
 
 bool bedline::operator<(const bedline &b) const {
-  if ( chrom != b.chrom ) {
-    return chrom<b.chrom;
+  if ( chromid != b.chromid ) {
+    return chromid<b.chromid;
   } else if (start != b.start) {
     return start<b.start;
   } else {
@@ -49,17 +98,27 @@ double bedline::midpoint() {
 
 
 
-bgdline::bgdline(const string &line) : set_midpoint(false) {
-  // Convert a string into a bedline object
+static_assert( sizeof(bgdline)==24, "bgdline should pack into 24 bytes" );
+
+bgdline::bgdline(const string &line) {
+  // Convert a string into a bgdline object
   stringstream sline;
+  string c;
   sline.str(line);
-  sline>>chrom>>start>>end>>value;
+  sline>>c>>start>>end>>value;
+  chrom = chrom_ids.id(c);
+}
+
+bgdline::bgdline(const bgdview &v) : chrom(v.chromid), start(v.start),
+				      end(v.end), value(v.value) {
+  if ( chrom==NO_CHROM ) {
+    chrom = chrom_ids.id( v.chrom.str() );
+  }
 }
 
 bgdline::bgdline(const string &c, const long int &s,
-		 const long int &e,const double &v) : chrom(c), start(s),
-						      end(e), value(v) ,
-						      set_midpoint(false) {}
+		 const long int &e,const double &v) : chrom(chrom_ids.id(c)), start(s),
+						      end(e), value(v) {}
 
 
 
@@ -73,11 +132,804 @@ bool bgdline::operator<(const bgdline &b) const {
   }
 }
 
-double bgdline::midpoint() const {
-  // Find the midpoint (bp) of the region
-  if (!set_midpoint) {
-    the_midpoint = 0.5*(start+end);
-    set_midpoint = true;
+
+
+bgdreader::bgdreader(const string &file,const int &vcol) : filename(file), data(0), size(0),
+							     pos(0), stop(0), stop_after(LONG_MAX),
+							     is_good(false), is_mapped(false), compressed(false),
+							     valuecol(vcol), bin(0), bw(0), tbi(0),
+							     binchr(0), binchr_end(0), binrec(0),
+							     lastid(NO_CHROM) {
+  // Map the whole file. Fall back to reading it into memory for things
+  // which cannot be mapped (pipes, empty files).
+  int fd = open(file.c_str(),O_RDONLY);
+  if (fd<0) {
+    return;
   }
-  return the_midpoint;
+  struct stat sb;
+  if ( fstat(fd,&sb)==0 && S_ISREG(sb.st_mode) && sb.st_size>0 ) {
+    void *p = mmap(0,sb.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    if (p!=MAP_FAILED) {
+      madvise(p,sb.st_size,MADV_SEQUENTIAL);
+      data = static_cast<const char*>(p);
+      size = sb.st_size;
+      is_mapped = true;
+    }
+  }
+  if (!is_mapped) {
+    char buf[65536];
+    ssize_t n;
+    while ( (n=read(fd,buf,sizeof(buf)))>0 ) {
+      buffer.append(buf,n);
+    }
+    data = buffer.data();
+    size = buffer.size();
+  }
+  close(fd);
+  is_good = true;
+
+  if ( is_bgzf(data,size) ) {
+    tbi = new tabixindex;
+    compressed = tbi->load(file);
+  }
+  if ( is_gzip(data,size) && !compressed ) {
+    inflate();
+  }
+  stop = size;
+
+  if ( binprofile::is_binprofile(data,size) ) {
+    bin = new binprofile;
+    is_good = bin->load(data,size);
+    binchr_end = bin->chroms.size();
+  } else if ( bigwig::is_bigwig(data,size) ) {
+    bw = new bigwig;
+    is_good = bw->load(data,size);
+  }
+}
+
+void bgdreader::inflate() {
+  // Replace the compressed contents by the inflated text
+  string inflated,
+    error;
+  is_good = gunzip(data,size,inflated,error);
+  if ( !is_good ) {
+    cerr<<" Warning : Cannot decompress file "<<filename<<" ("<<error<<")"<<endl;
+  }
+  use_buffer(inflated);
+  pos = 0;
+  stop = size;
+}
+
+void bgdreader::use_buffer(string &text) {
+  // read text (which is swapped in) rather than the file
+  if (is_mapped) {
+    munmap(const_cast<char*>(data),size);
+    is_mapped = false;
+  }
+  compressed = false;
+  buffer.swap(text);
+  data = buffer.data();
+  size = buffer.size();
+}
+
+bgdreader::~bgdreader() {
+  delete bin;
+  delete bw;
+  delete tbi;
+  if (is_mapped) {
+    munmap(const_cast<char*>(data),size);
+  }
+}
+
+bool bgdreader::getline(strview &line) {
+  // Get the next line (without the newline). The last line is copied if it
+  // is not terminated, so that the number parsers always find an end.
+  if (compressed) {
+    inflate();
+  }
+  if (pos>=stop || is_binary()) {
+    return false;
+  }
+  const char *start = data+pos,
+    *eol = static_cast<const char*>( memchr(start,'\n',size-pos) );
+  if (eol) {
+    line.ptr = start;
+    line.len = eol-start;
+    pos += line.len+1;
+  } else {
+    tail.assign(start,size-pos);
+    line.ptr = tail.c_str();
+    line.len = tail.size();
+    pos = size;
+  }
+  return true;
+}
+
+bool bgdreader::parse(const strview &line,bgdview &v) const {
+  // Split a line into fields in place. Returns false for header and blank
+  // lines. Missing numeric fields are set to zero.
+  const char *p = line.ptr,
+    *eol = line.ptr+line.len,
+    *q;
+
+  while (p<eol && (*p==' ' || *p=='\t')) {++p;}
+  if ( p==eol || *p=='#' ||
+       (eol-p>=5 && strncmp(p,"track",5)==0) ||
+       (eol-p>=7 && strncmp(p,"browser",7)==0) ) {
+    return false;
+  }
+
+  v.chrom.ptr = p;
+  while (p<eol && *p!=' ' && *p!='\t') {++p;}
+  v.chrom.len = p-v.chrom.ptr;
+
+  v.start = v.end = 0;
+  v.value = 0.0;
+  for (int col=1; col<=valuecol; ++col) {
+    while (p<eol && (*p==' ' || *p=='\t')) {++p;}
+    if (p==eol) {
+      break;
+    }
+    if (col==1) {
+      v.start = parse_long(p,&q); p=q;
+    } else if (col==2) {
+      v.end = parse_long(p,&q); p=q;
+    } else if (col==valuecol) {
+      v.value = parse_double(p,&q); p=q;
+    } else {
+      while (p<eol && *p!=' ' && *p!='\t') {++p;}
+    }
+  }
+  return true;
+}
+
+bool bgdreader::next(bgdview &v) {
+  // Get the next data line
+  if (bw) {
+    if ( !bw->next(v) ) {
+      return false;
+    }
+    set_chromid(v);
+    return true;
+  }
+  if (bin) {
+    while ( binchr<binchr_end && binrec>=bin->chroms[binchr].n ) {
+      binchr++;
+      binrec=0;
+    }
+    if ( binchr>=binchr_end ) {
+      return false;
+    }
+    const binchrom &c = bin->chroms[binchr];
+    v.chrom = c.name;
+    v.start = c.start[binrec];
+    v.end = c.end[binrec];
+    v.value = c.value[binrec];
+    binrec++;
+    set_chromid(v);
+    return true;
+  }
+
+  strview line;
+  linefields f;
+  while ( true ) {
+    if (compressed) {
+      inflate();
+    }
+    if (pos>=stop) {
+      return false;
+    }
+    if ( scan_line(data+pos,data+size,valuecol+1,f) && parse_fields(f,v) ) {
+      pos = f.eol+1-data;
+    } else if ( !getline(line) ) {
+      return false;
+    } else if ( !parse(line,v) ) {
+      continue;
+    }
+    if ( v.start>stop_after ) {
+      pos = stop;
+      return false;
+    }
+    set_chromid(v);
+    return true;
+  }
+}
+
+bool bgdreader::parse_fields(const linefields &f,bgdview &v) const {
+  // As parse(), for a line already split by scan_line(). Returns false if
+  // the line is not an ordinary data line, with every column up to the
+  // value present and each number taking up its whole field, so that
+  // parse() deals with anything unusual.
+  if ( f.n<valuecol+1 || valuecol<3 || *f.start[0]=='#' ||
+       (f.eol-f.start[0]>=5 && strncmp(f.start[0],"track",5)==0) ||
+       (f.eol-f.start[0]>=7 && strncmp(f.start[0],"browser",7)==0) ) {
+    return false;
+  }
+  const char *q;
+  v.chrom.ptr = f.start[0];
+  v.chrom.len = f.end[0]-f.start[0];
+  v.start = parse_long(f.start[1],&q);
+  if ( q!=f.end[1] ) {
+    return false;
+  }
+  v.end = parse_long(f.start[2],&q);
+  if ( q!=f.end[2] ) {
+    return false;
+  }
+  v.value = parse_double(f.start[valuecol],&q);
+  return q==f.end[valuecol];
+}
+
+void bgdreader::set_chromid(bgdview &v) {
+  // the id is only looked up when the chromosome changes
+  if ( lastid==NO_CHROM || lastchrom!=v.chrom ) {
+    lastchrom = v.chrom.str();
+    lastid = chrom_ids.id(lastchrom);
+  }
+  v.chromid = lastid;
+}
+
+bool bgdreader::seek_region(const string &chrom,const long int &from,const long int &to) {
+  // Returns false (and reads the whole file as usual) if there is no index
+  if (bin) {
+    binchr = binchr_end = bin->chroms.size();
+    binrec = 0;
+    for (size_t c=0; c<bin->chroms.size(); ++c) {
+      if ( chrom==bin->chroms[c].name ) {
+	binchr = c;
+	binchr_end = c+1;
+      }
+    }
+    return true;
+  }
+  if (bw) {
+    bw->seek(chrom,from,to);
+    return true;
+  }
+
+  if (compressed) {
+    // inflate only the blocks the tabix index gives for the region
+    string region,
+      error;
+    if ( !tbi->read_region(data,size,chrom,from,to,region,error) ) {
+      cerr<<" Warning : Cannot read region of file "<<filename<<" ("<<error<<")"<<endl;
+      is_good = false;
+    }
+    use_buffer(region);
+    pos = 0;
+    stop = size;
+    stop_after = to;
+    return true;
+  }
+
+  bgdindex idx;
+  if ( !idx.load(filename) ) {
+    return false;
+  }
+  seek_region(idx,chrom,from,to);
+  return true;
+}
+
+void bgdreader::seek_region(const bgdindex &idx,const string &chrom,const long int &from,const long int &to) {
+  // As above, with an index which is already loaded (text files only)
+  if (compressed) {
+    inflate();
+  }
+  map<string,chromoffsets>::const_iterator c = idx.chroms.find(chrom);
+  if ( c==idx.chroms.end() ) {
+    pos = stop = size;
+    return;
+  }
+  size_t k = from>0 ? from/idx.stride : 0;
+  pos = k<c->second.checkpoints.size() ? c->second.checkpoints[k] : c->second.end;
+  stop = c->second.end;
+  stop_after = to;
+}
+
+
+
+bool bgdindex::build(const string &file,const long int &s,string &error) {
+  // Index a text bedGraph, which must be sorted by chromosome then start
+  bgdreader bgdf(file);
+  if ( !bgdf.good() || bgdf.is_binary() ) {
+    error = "cannot read as a text bedGraph";
+    return false;
+  }
+  stride = s;
+  chroms.clear();
+
+  strview line;
+  bgdview v;
+  chromoffsets *cur=0;
+  string last;
+  long int laststart=0;
+  size_t offset=bgdf.tell();
+  while ( bgdf.getline(line) ) {
+    if ( bgdf.parse(line,v) ) {
+      if ( cur==0 || v.chrom!=last ) {
+	if ( cur!=0 ) {
+	  cur->end = offset;
+	}
+	last = v.chrom.str();
+	if ( chroms.count(last)!=0 ) {
+	  error = "chromosome "+last+" is not in one block, file is not sorted";
+	  return false;
+	}
+	cur = &chroms[last];
+	cur->begin = offset;
+	laststart = v.start;
+      }
+      if ( v.start<laststart ) {
+	error = "file is not sorted by start on "+v.chrom.str();
+	return false;
+      }
+      while ( long(cur->checkpoints.size())*stride <= v.end ) {
+	cur->checkpoints.push_back(offset);
+      }
+      laststart = v.start;
+    }
+    offset=bgdf.tell();
+  }
+  if ( !bgdf.good() ) {
+    error = "cannot read file";
+    return false;
+  }
+  if ( cur!=0 ) {
+    cur->end = offset;
+  }
+  return true;
+}
+
+bool bgdindex::write(const string &file) const {
+  struct stat sb;
+  if ( stat(file.c_str(),&sb)!=0 ) {
+    return false;
+  }
+  ofstream ouf( (file+".idx").c_str() );
+  ouf<<"#bdgindex\t"<<stride<<"\t"<<sb.st_size<<"\t"<<sb.st_mtime<<"\n";
+  for (map<string,chromoffsets>::const_iterator it=chroms.begin(); it!=chroms.end(); ++it) {
+    ouf<<it->first<<"\t"<<it->second.begin<<"\t"<<it->second.end<<"\t"<<it->second.checkpoints.size();
+    for (size_t k=0; k<it->second.checkpoints.size(); ++k) {
+      ouf<<"\t"<<it->second.checkpoints[k];
+    }
+    ouf<<"\n";
+  }
+  ouf.close();
+  return ouf.good();
+}
+
+bool bgdindex::load(const string &file) {
+  // Load file.idx, returns false if there is none or it is out of date
+  struct stat sb;
+  ifstream inf( (file+".idx").c_str() );
+  if ( !inf.good() || stat(file.c_str(),&sb)!=0 ) {
+    return false;
+  }
+  string line,
+    magic;
+  long long fsize,
+    mtime;
+  getline(inf,line);
+  istringstream sline(line);
+  if ( !(sline>>magic>>stride>>fsize>>mtime) || magic!="#bdgindex" ||
+       fsize!=sb.st_size || mtime!=sb.st_mtime || stride<=0 ) {
+    return false;
+  }
+  chroms.clear();
+  while ( getline(inf,line) ) {
+    istringstream cline(line);
+    string chrom;
+    size_t n;
+    cline>>chrom;
+    chromoffsets &c = chroms[chrom];
+    cline>>c.begin>>c.end>>n;
+    c.checkpoints.resize(n);
+    for (size_t k=0; k<n; ++k) {
+      cline>>c.checkpoints[k];
+    }
+    if ( !cline ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+bool profilesums::build(const string &file,string &error) {
+  // Make the tables from a text or binary profile
+  bgdreader bgdf(file);
+  if ( !bgdf.good() ) {
+    error = "cannot open file";
+    return false;
+  }
+  chroms.clear();
+
+  bgdview v;
+  chromsums *cur=0;
+  string last;
+  long double sum=0.0;
+  while ( bgdf.next(v) ) {
+    if ( cur==0 || v.chrom!=last ) {
+      last = v.chrom.str();
+      if ( chroms.count(last)!=0 ) {
+	error = "chromosome "+last+" is not in one block, file is not sorted";
+	return false;
+      }
+      cur = &chroms[last];
+      cur->csum.push_back(0.0);
+      sum = 0.0;
+    }
+    if ( !cur->end.empty() && v.start<cur->end.back() ) {
+      error = "entries on "+last+" are not sorted or overlap";
+      return false;
+    }
+    sum += v.value;
+    cur->start.push_back(v.start);
+    cur->end.push_back(v.end);
+    cur->csum.push_back(sum);
+  }
+  if ( !bgdf.good() ) {
+    error = "cannot read file";
+    return false;
+  }
+  return true;
+}
+
+bool profilesums::write(const string &file) const {
+  // Save the tables to file.psum, along with the size and modification
+  // time of the profile
+  struct stat sb;
+  if ( stat(file.c_str(),&sb)!=0 ) {
+    return false;
+  }
+  ofstream ouf( (file+".psum").c_str(), ios::binary );
+  int64_t fsize=sb.st_size,
+    mtime=sb.st_mtime;
+  uint32_t nchrom=chroms.size(),
+    ldsize=sizeof(long double);
+  ouf.write("CCPSUM01",8);
+  ouf.write(reinterpret_cast<const char*>(&fsize),8);
+  ouf.write(reinterpret_cast<const char*>(&mtime),8);
+  ouf.write(reinterpret_cast<const char*>(&nchrom),4);
+  ouf.write(reinterpret_cast<const char*>(&ldsize),4);
+  for (map<string,chromsums>::const_iterator it=chroms.begin(); it!=chroms.end(); ++it) {
+    uint32_t namelen=it->first.size();
+    uint64_t n=it->second.start.size();
+    ouf.write(reinterpret_cast<const char*>(&namelen),4);
+    ouf.write(it->first.data(),namelen);
+    ouf.write(reinterpret_cast<const char*>(&n),8);
+    ouf.write(reinterpret_cast<const char*>(it->second.start.data()),n*sizeof(long int));
+    ouf.write(reinterpret_cast<const char*>(it->second.end.data()),n*sizeof(long int));
+    ouf.write(reinterpret_cast<const char*>(it->second.csum.data()),(n+1)*sizeof(long double));
+  }
+  ouf.close();
+  return ouf.good();
+}
+
+bool profilesums::load(const string &file) {
+  // Load file.psum, returns false if there is none or it is out of date
+  struct stat sb;
+  ifstream inf( (file+".psum").c_str(), ios::binary );
+  if ( !inf.good() || stat(file.c_str(),&sb)!=0 ) {
+    return false;
+  }
+  char magic[8];
+  int64_t fsize,
+    mtime;
+  uint32_t nchrom,
+    ldsize;
+  inf.read(magic,8);
+  inf.read(reinterpret_cast<char*>(&fsize),8);
+  inf.read(reinterpret_cast<char*>(&mtime),8);
+  inf.read(reinterpret_cast<char*>(&nchrom),4);
+  inf.read(reinterpret_cast<char*>(&ldsize),4);
+  if ( !inf || memcmp(magic,"CCPSUM01",8)!=0 || fsize!=sb.st_size ||
+       mtime!=sb.st_mtime || ldsize!=sizeof(long double) ) {
+    return false;
+  }
+  chroms.clear();
+  for (uint32_t c=0; c<nchrom; ++c) {
+    uint32_t namelen;
+    uint64_t n;
+    inf.read(reinterpret_cast<char*>(&namelen),4);
+    string name(namelen,' ');
+    inf.read(&name[0],namelen);
+    inf.read(reinterpret_cast<char*>(&n),8);
+    if ( !inf ) {
+      return false;
+    }
+    chromsums &cs = chroms[name];
+    cs.start.resize(n);
+    cs.end.resize(n);
+    cs.csum.resize(n+1);
+    inf.read(reinterpret_cast<char*>(cs.start.data()),n*sizeof(long int));
+    inf.read(reinterpret_cast<char*>(cs.end.data()),n*sizeof(long int));
+    inf.read(reinterpret_cast<char*>(cs.csum.data()),(n+1)*sizeof(long double));
+  }
+  return bool(inf);
+}
+
+bool profilesums::open(const string &file,string &error) {
+  // Use the saved tables if they are up to date, otherwise build them
+  return load(file) || build(file,error);
+}
+
+rangesum profilesums::get_range(const chromsums &cs,const size_t &i0,const size_t &i1) const {
+  // entries i0 to i1-1
+  rangesum r;
+  if ( i1>i0 ) {
+    r.sum = cs.csum[i1]-cs.csum[i0];
+    r.count = i1-i0;
+    r.from = cs.start[i0];
+    r.to = cs.end[i1-1];
+  }
+  return r;
+}
+
+rangesum profilesums::overlapping(const string &chrom,const double &from,const double &to) const {
+  // Entries with end>from and start<to
+  map<string,chromsums>::const_iterator c = chroms.find(chrom);
+  if ( c==chroms.end() ) {
+    return rangesum();
+  }
+  const chromsums &cs = c->second;
+  size_t i0 = upper_bound(cs.end.begin(),cs.end.end(),from) - cs.end.begin(),
+    i1 = lower_bound(cs.start.begin(),cs.start.end(),to) - cs.start.begin();
+  return get_range(cs,i0,i1);
+}
+
+rangesum profilesums::midpoints(const string &chrom,const double &from,const double &to) const {
+  // Entries with midpoint in (from,to]. Midpoints are in order since entries
+  // do not overlap.
+  map<string,chromsums>::const_iterator c = chroms.find(chrom);
+  if ( c==chroms.end() ) {
+    return rangesum();
+  }
+  const chromsums &cs = c->second;
+  size_t lo, hi, i[2];
+  double edge[2] = {from,to};
+  for (int k=0; k<2; ++k) {
+    // first entry with midpoint > edge
+    lo = 0;
+    hi = cs.start.size();
+    while (lo<hi) {
+      size_t m = lo+(hi-lo)/2;
+      if ( 0.5*(cs.start[m]+cs.end[m]) > edge[k] ) {
+	hi = m;
+      } else {
+	lo = m+1;
+      }
+    }
+    i[k] = lo;
+  }
+  return get_range(cs,i[0],i[1]);
+}
+
+
+static bool write_all(const int &fd,const char *p,size_t n) {
+  while ( n>0 ) {
+    ssize_t w = ::write(fd,p,n);
+    if ( w<0 ) {
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+bgdwriter::bgdwriter() : fd(-1), is_good(false), background(false), have_pending(false),
+			 done(false), failed(false), zip(0), used(0), pending_used(0) {}
+
+bgdwriter::bgdwriter(const string &file,const bool &bg,const bool &bgzf) : fd(-1), is_good(false), background(false),
+									 have_pending(false), done(false), failed(false),
+									 zip(0), used(0), pending_used(0) {
+  open(file,bg,bgzf);
+}
+
+bgdwriter::~bgdwriter() {
+  close();
+}
+
+bool bgdwriter::open(const string &file,const bool &bg,const bool &bgzf) {
+  close();
+  fd = ::open(file.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0666);
+  is_good = fd>=0;
+  failed = false;
+  if ( bgzf && is_good ) {
+    zip = new bgzfdeflate;
+    is_good = zip->good();
+  }
+  background = bg && is_good;
+  buffer.resize(bufsize);
+  used = 0;
+  if ( background ) {
+    pending.resize(bufsize);
+    have_pending = false;
+    done = false;
+    writer = thread( &bgdwriter::write_pending, this );
+  }
+  return is_good;
+}
+
+void bgdwriter::close() {
+  // Write out what is left and wait for the writer thread to finish;
+  // good() then tells whether everything was written
+  if ( fd<0 ) {
+    return;
+  }
+  flush();
+  if ( background ) {
+    {
+      unique_lock<mutex> lk(lock);
+      done = true;
+    }
+    ready.notify_all();
+    writer.join();
+  }
+  if ( zip ) {
+    zipped.clear();
+    bgzfdeflate::eof(zipped);
+    if ( !write_all(fd,&zipped[0],zipped.size()) ) {
+      failed = true;
+    }
+    delete zip;
+    zip = 0;
+  }
+  if ( ::close(fd)!=0 ) {
+    failed = true;
+  }
+  fd = -1;
+}
+
+void bgdwriter::flush() {
+  // Send the buffer to the file, or to the writer thread
+  if ( used==0 ) {
+    return;
+  }
+  if ( !background ) {
+    if ( !output(&buffer[0],used) ) {
+      failed = true;
+    }
+  } else {
+    unique_lock<mutex> lk(lock);
+    while ( have_pending ) {
+      ready.wait(lk);
+    }
+    buffer.swap(pending);
+    pending_used = used;
+    have_pending = true;
+    lk.unlock();
+    ready.notify_all();
+  }
+  used = 0;
+}
+
+void bgdwriter::write_pending() {
+  // Writer thread: write each buffer handed over by flush()
+  unique_lock<mutex> lk(lock);
+  while ( true ) {
+    while ( !have_pending && !done ) {
+      ready.wait(lk);
+    }
+    if ( !have_pending ) {
+      return;
+    }
+    lk.unlock();
+    if ( !output(&pending[0],pending_used) ) {
+      failed = true;
+    }
+    lk.lock();
+    have_pending = false;
+    ready.notify_all();
+  }
+}
+
+bool bgdwriter::output(const char *p,const size_t &n) {
+  // Write to the file, compressing first for BGZF
+  if ( !zip ) {
+    return write_all(fd,p,n);
+  }
+  zipped.clear();
+  return zip->compress(p,n,zipped) && write_all(fd,&zipped[0],zipped.size());
+}
+
+void bgdwriter::write(const char *p,const size_t &n) {
+  if ( used+n>bufsize ) {
+    flush();
+    if ( n>bufsize ) {
+      // too big to buffer, write it directly
+      if ( background ) {
+	unique_lock<mutex> lk(lock);
+	while ( have_pending ) {
+	  ready.wait(lk);
+	}
+      }
+      if ( !output(p,n) ) {
+	failed = true;
+      }
+      return;
+    }
+  }
+  memcpy(&buffer[used],p,n);
+  used += n;
+}
+
+bgdwriter& bgdwriter::operator<<(const char &c) {
+  if ( used==bufsize ) {
+    flush();
+  }
+  buffer[used++] = c;
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const char *p) {
+  write(p,strlen(p));
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const string &str) {
+  write(str.data(),str.size());
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const strview &str) {
+  write(str.ptr,str.len);
+  return *this;
+}
+
+void bgdwriter::put_unsigned(unsigned long long int u) {
+  char digits[24];
+  char *p = digits+sizeof(digits);
+  do {
+    *--p = '0'+u%10;
+    u /= 10;
+  } while ( u>0 );
+  write(p,digits+sizeof(digits)-p);
+}
+
+void bgdwriter::put_signed(const long long int &i) {
+  if ( i<0 ) {
+    *this<<'-';
+    put_unsigned( 0ULL-(unsigned long long int)i );
+  } else {
+    put_unsigned(i);
+  }
+}
+
+bgdwriter& bgdwriter::operator<<(const int &i) {
+  put_signed(i);
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const unsigned int &u) {
+  put_unsigned(u);
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const long int &i) {
+  put_signed(i);
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const unsigned long int &u) {
+  put_unsigned(u);
+  return *this;
+}
+
+bgdwriter& bgdwriter::operator<<(const double &d) {
+  // Same as ostream's default (printf "%g"); whole numbers below 1e6, which
+  // %g prints without a decimal point or exponent, skip printf
+  if ( d>-1e6 && d<1e6 && d==floor(d) ) {
+    if ( d==0 && signbit(d) ) {
+      *this<<'-';
+    }
+    put_signed( (long long int)d );
+  } else {
+    char text[32];
+    int n = snprintf(text,sizeof(text),"%g",d);
+    write(text,n);
+  }
+  return *this;
 }
@@ -9,19 +9,62 @@
 #define BEDFILES_H
 
 #include<string>
+#include<vector>
+#include<map>
+#include<climits>
+#include<cstddef>
+#include<atomic>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<deque>
+#include<unordered_map>
+#include<stdint.h>
 
 using namespace std;
 
+struct strview {
+  // a field of a line, pointing into a buffer owned by someone else
+  const char *ptr;
+  size_t len;
+  strview() : ptr(0), len(0) {};
+  string str() const { return string(ptr,len); }
+};
+
+bool operator==(const string&, const strview&);
+bool operator==(const strview&, const string&);
+bool operator!=(const string&, const strview&);
+bool operator!=(const strview&, const string&);
+
+#define NO_CHROM UINT32_MAX
+
+class chromdict {
+  // Chromosome names and small integer ids, given out in the order the
+  // names are first seen, so that records and comparisons use integers.
+  // There is one for the whole run (chrom_ids), used from any thread.
+public:
+  uint32_t id(const string&);
+  const string& name(const uint32_t&) const;
+private:
+  unordered_map<string,uint32_t> ids;
+  deque<string> names;     // a deque, so names stay put as more are added
+  mutable mutex lock;
+};
+
+extern chromdict chrom_ids;
+
+
 struct bedline {
   // data structure for bed file entry
   string chrom,
     name,
     strand;
+  uint32_t chromid;
   long int start,
     end;
   int istrand;
   bedline(const string&);
-bedline() : chrom("0"), start(0), end(1) {};
+bedline() : chrom("0"), chromid(NO_CHROM), start(0), end(1) {};
   bool operator<(const bedline&) const;  
   double midpoint();
 
@@ -31,21 +74,211 @@ private:
 };
 
 
-struct bgdline {
-  // data structure for bedGraph file entry
-  string chrom;
+struct bgdview {
+  // bedGraph file entry as returned by bgdreader; chrom points into the
+  // reader's buffer and is only valid until the reader is destroyed.
+  // chromid is set by next() (not parse()).
+  strview chrom;
+  uint32_t chromid;
   long int start,
     end;
   double value;
-  bgdline(const string&);
-  bgdline(const string &, const long int &, const long int &,const double &);
-  bool operator<(const bgdline&) const;  
-  double midpoint() const;
+  bgdview() : chromid(NO_CHROM) {};
+  double midpoint() const { return 0.5*(start+end); }
+};
+
+
+struct chromoffsets {
+  // byte range of one chromosome in a sorted bedGraph, and for each k the
+  // offset of the first line with end >= k*stride
+  size_t begin,
+    end;
+  vector<size_t> checkpoints;
+};
+
+
+struct bgdindex {
+  // Sidecar index (file.idx) for a bedGraph sorted by chromosome and start.
+  // It records the size and modification time of the file, and is ignored
+  // if these do not match.
+  long int stride;
+  map<string,chromoffsets> chroms;
+  bool build(const string&,const long int&,string&);
+  bool write(const string&) const;
+  bool load(const string&);
+};
+
+
+class binprofile;
+class bigwig;
+struct linefields;
+class bgzfdeflate;
+struct tabixindex;
+
+class bgdreader {
+  // Reads a bedGraph file in place via mmap, without a per line allocation.
+  // Header (track, browser, #) and blank lines are skipped by next().
+  // gzip and BGZF files are inflated into memory when opened (BGZF on
+  // several threads) and then read in the same way. A BGZF file with a
+  // tabix index (file.tbi) is left compressed until it is read, so that
+  // seek_region() only inflates the blocks holding the region.
+  // Binary profiles (see binprofile.h) and bigWig files (see bigwig.h) are
+  // detected and read transparently by next(); getline() and parse() only
+  // apply to text files.
+  // seek_region() restricts next() to one chromosome, and to lines which may
+  // overlap [from,to] if the file has an index; callers still have to test
+  // each line, this only skips those which are sure not to be wanted.
+public:
+  bgdreader(const string&, const int &valuecol=3);
+  ~bgdreader();
+  bool good() const { return is_good; }
+  bool next(bgdview&);
+  bool getline(strview&);
+  bool parse(const strview&, bgdview&) const;
+  bool is_binary() const { return bin!=0 || bw!=0; }
+  const bigwig* get_bigwig() const { return bw; }
+  bool seek_region(const string&,const long int &from=0,const long int &to=LONG_MAX);
+  void seek_region(const bgdindex&,const string&,const long int &from=0,const long int &to=LONG_MAX);
+  size_t tell() const { return pos; }
 
 private:
-  mutable double the_midpoint;
-  mutable bool set_midpoint;
+  bgdreader(const bgdreader&);
+  bgdreader& operator=(const bgdreader&);
+
+  void inflate();
+  void use_buffer(string&);
+  void set_chromid(bgdview&);
+  bool parse_fields(const linefields&,bgdview&) const;
 
+  string filename;
+  const char *data;
+  size_t size,
+    pos,
+    stop;       // end of the region set by seek_region()
+  long int stop_after;
+  bool is_good,
+    is_mapped,
+    compressed;   // data is still BGZF, see tbi
+  int valuecol;
+  binprofile *bin;
+  bigwig *bw;
+  tabixindex *tbi;
+  size_t binchr,
+    binchr_end,
+    binrec;
+  string buffer,  // file contents if it could not be mapped
+    tail,         // copy of a last line with no newline
+    lastchrom;
+  uint32_t lastid;
+};
+
+
+struct rangesum {
+  // result of a profilesums query: total value, number of entries and the
+  // region they actually cover (from the first start to the last end)
+  double sum;
+  long int count,
+    from,
+    to;
+  rangesum() : sum(0.0), count(0), from(0), to(0) {};
+};
+
+
+class profilesums {
+  // Cumulative sums of a profile, one table per chromosome, so that the sum
+  // over any range is found with two binary searches. The profile must be
+  // sorted by start with no overlapping entries. Sums are kept in long
+  // double, so range sums can differ from a direct sum in the last digits.
+  // The tables can be saved to file.psum and are reused while the profile
+  // is unchanged.
+public:
+  bool build(const string&,string&);
+  bool write(const string&) const;
+  bool load(const string&);
+  bool open(const string&,string&);
+  rangesum overlapping(const string&,const double&,const double&) const;
+  rangesum midpoints(const string&,const double&,const double&) const;
+
+private:
+  struct chromsums {
+    vector<long int> start,
+      end;
+    vector<long double> csum;   // csum[i] is the sum of the first i values
+  };
+  map<string,chromsums> chroms;
+  rangesum get_range(const chromsums&,const size_t&,const size_t&) const;
+};
+
+
+class bgdwriter {
+  // Buffered writer for text output. Lines are collected in a large buffer
+  // which is written with one system call when full, rather than flushing
+  // every line. Numbers are formatted as by an ostream with the default
+  // settings (doubles to 6 significant figures), so output is unchanged.
+  // With background set, full buffers are written by a second thread while
+  // the caller fills the next one. Use "\n" rather than endl. With bgzf set
+  // the output is compressed as BGZF (by the writer thread if there is one).
+public:
+  bgdwriter();
+  bgdwriter(const string&, const bool &background=false, const bool &bgzf=false);
+  ~bgdwriter();
+  bool open(const string&, const bool &background=false, const bool &bgzf=false);
+  bool good() const { return is_good && !failed; }
+  void close();
+  void write(const char*, const size_t&);
+  bgdwriter& operator<<(const char&);
+  bgdwriter& operator<<(const char*);
+  bgdwriter& operator<<(const string&);
+  bgdwriter& operator<<(const strview&);
+  bgdwriter& operator<<(const int&);
+  bgdwriter& operator<<(const unsigned int&);
+  bgdwriter& operator<<(const long int&);
+  bgdwriter& operator<<(const unsigned long int&);
+  bgdwriter& operator<<(const double&);
+
+private:
+  bgdwriter(const bgdwriter&);
+  bgdwriter& operator=(const bgdwriter&);
+
+  void put_signed(const long long int&);
+  void put_unsigned(unsigned long long int);
+  void flush();
+  void write_pending();
+  bool output(const char*,const size_t&);
+
+  static const size_t bufsize = 1<<20;
+  int fd;
+  bool is_good,
+    background,
+    have_pending,  // pending holds a buffer for the writer thread
+    done;
+  atomic<bool> failed;
+  vector<char> buffer,
+    pending,
+    zipped;
+  bgzfdeflate *zip;
+  size_t used,
+    pending_used;
+  thread writer;
+  mutex lock;
+  condition_variable ready;
+};
+
+
+struct bgdline {
+  // bedGraph file entry packed into 24 bytes: the chromosome id (see
+  // chromdict), start and end on the chromosome, and the value. Sorted by
+  // chromosome id, then start and end.
+  uint32_t chrom,
+    start,
+    end;
+  double value;
+  bgdline(const string&);
+  bgdline(const bgdview&);
+  bgdline(const string &, const long int &, const long int &,const double &);
+  bool operator<(const bgdline&) const;
+  double midpoint() const { return 0.5*(double(start)+double(end)); }
+  const string& chrom_name() const { return chrom_ids.name(chrom); }
 };
 
 
@@ -0,0 +1,935 @@
+//***************************************************************************
+//
+// Program to time parsing, the metric kernels and each of the tools on a
+// data set from make_synthetic, so that changes in speed can be tracked.
+// Run with make bench.
+//
+//***************************************************************************
+
+#include<iostream>
+#include<iomanip>
+#include<cstdlib>
+#include<string>
+#include<vector>
+#include<map>
+#include<fstream>
+#include<sstream>
+#include<chrono>
+#include<functional>
+#include<algorithm>
+#include<climits>
+#include<cstring>
+#include<cstdio>
+#include<random>
+#include<cmath>
+#include<unistd.h>
+#include<sys/stat.h>
+
+#include "bedfiles.h"
+#include "metrics.h"
+#include "fastparse.h"
+#include "quantilesketch.h"
+
+using namespace std;
+
+struct benchresult {
+  // best time over the repeats, and the amount of input it covered
+  string name;
+  double seconds;
+  long int lines,
+    bytes;
+};
+
+struct loadedprofile {
+  // a profile held in memory, for timing the kernels without reading
+  bgdreader *reader;
+  vector<bgdview> lines;
+  string target;
+};
+
+double time_best(const int&,const function<void()>&);
+void print_result(const benchresult&);
+long int file_size(const string&);
+long int check_profiles(const vector<string>&,long int&);
+long int check_numbers(long int&);
+long int check_scan(long int&);
+long int check_simd(long int&);
+long int check_sums(const vector<string>&,const vector<string>&,map<string,bedline>&,long int&);
+long int check_sketch(long int&,double&);
+long int check_tools(const string&,long int&);
+void write_text(const string&,const string&);
+string read_text(const string&);
+bool run_quiet(const string&);
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<3) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./benchmarks -d datadir [-r REPEATS] [-x bindir] [-j N]"<<endl;
+    cout<<"where       datadir      is a data set made by make_synthetic."<<endl;
+    cout<<"            REPEATS      is the number of times each benchmark is run; the fastest is reported (Default 3)."<<endl;
+    cout<<"            bindir       is the directory with the tools (Default the current directory)."<<endl;
+    cout<<"            N            is the number of threads given to the tools with a -j option (Default 1)."<<endl;
+    cout<<endl;
+    cout<<"For each benchmark the output gives the time in seconds and the rate in lines and MB of"<<endl;
+    cout<<"input per second. Output of the tools is written to datadir/bench_out."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string datadir,
+    bindir=".";
+  int repeats=3,
+    nthreads=1;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-d" ) {
+      // data directory
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-d)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      datadir = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-r" ) {
+      // repeats
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-r)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      repeats = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-x" ) {
+      // directory with the tools
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-x)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      bindir = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-j" ) {
+      // threads for the tools
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  if ( repeats<1 || nthreads<1 ) {
+    cerr<<"Error: REPEATS and N must be at least 1"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // The file lists have paths relative to datadir, so work from there
+  char *absbin = realpath(bindir.c_str(),0);
+  if ( absbin==0 ) {
+    cerr<<" ERROR : Cannot find directory "<<bindir<<endl;
+    exit(EXIT_FAILURE);
+  }
+  bindir = string(absbin);
+  free(absbin);
+  if ( chdir(datadir.c_str())!=0 ) {
+    cerr<<" ERROR : Cannot open directory "<<datadir<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Read the targets and the list of all profiles
+  ifstream inf;
+  string line;
+  map<string,bedline> targets;
+  inf.open("targets.bed");
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<datadir<<"/targets.bed"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  while ( getline(inf,line) ) {
+    bedline newtrg(line);
+    targets[newtrg.name]=newtrg;
+  }
+  inf.close();
+
+  vector<string> files,
+    trgnames;
+  inf.open("filelist_withCond.txt");
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<datadir<<"/filelist_withCond.txt"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  while ( getline(inf,line) ) {
+    istringstream sline(line);
+    string filename,
+      condname,
+      trgname;
+    if ( sline>>filename>>condname>>trgname ) {
+      files.push_back(filename);
+      trgnames.push_back(trgname);
+    }
+  }
+  inf.close();
+
+  long int total_bytes=0,
+    total_lines=0,
+    list_bytes=0,      // the profiles in filelist.txt
+    list_lines=0,
+    raw_bytes=0;
+  for (size_t i=0; i<files.size(); ++i) {
+    total_bytes += file_size(files[i]);
+    string raw=files[i];
+    raw.replace( raw.find("normalizedpileup"), 16, "rawpileup" );
+    raw_bytes += file_size(raw);
+  }
+
+  cout<<"Benchmarks on "<<files.size()<<" profiles ("<<total_bytes/1048576.0<<" MB) in "<<datadir
+      <<", best of "<<repeats<<endl;
+  cout<<"# benchmark, seconds, lines/s, MB/s"<<endl;
+
+  // The fast parsers must give exactly what the stream and strtod() do
+  long int nlines=0,
+    nnumbers=0,
+    nbuffers=0,
+    nchunks=0,
+    bad = check_profiles(files,nlines)+check_numbers(nnumbers)+check_scan(nbuffers)+check_simd(nchunks);
+  cout<<"# parser check ("<<scan_simd_name()<<"): "<<nlines<<" lines, "<<nnumbers<<" numbers, "
+      <<nbuffers<<" buffer ends, "<<nchunks<<" chunks against scalar, "<<bad<<" mismatches"<<endl;
+  if ( bad>0 ) {
+    cerr<<" ERROR : The parsers do not agree"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Directionality from cumulative sums (index_bdg -p) must match reading
+  // the profile
+  long int nwindows=0;
+  bad = check_sums(files,trgnames,targets,nwindows);
+  cout<<"# prefix sum check: "<<nwindows<<" windows, "<<bad<<" mismatches"<<endl;
+  if ( bad>0 ) {
+    cerr<<" ERROR : Directionality from cumulative sums does not agree"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Sketches of parts of a stream, merged, must give ranks within their
+  // error bound of the exact ones
+  long int nranks=0;
+  double worst=0.0;
+  bad = check_sketch(nranks,worst);
+  cout<<"# sketch merge check: "<<nranks<<" ranks, worst error "<<worst<<" of eps*n, "<<bad<<" outside"<<endl;
+  if ( bad>0 ) {
+    cerr<<" ERROR : Merged quantile sketches are outside their error bound"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // The tools on small inputs made for the cases they have to handle
+  long int ncases=0;
+  bad = check_tools(bindir,ncases);
+  cout<<"# tool check: "<<ncases<<" cases, "<<bad<<" failures"<<endl;
+  if ( bad>0 ) {
+    cerr<<" ERROR : Not all of the tool checks passed"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Parsing: the mapped reader, and the getline and bgdline() which the tools
+  // used before
+  double t = time_best(repeats,[&]() {
+      total_lines=0;
+      for (size_t i=0; i<files.size(); ++i) {
+	bgdreader bgdf(files[i]);
+	bgdview datapoint;
+	while ( bgdf.next(datapoint) ) {
+	  ++total_lines;
+	}
+      }
+    });
+  print_result( benchresult{"parse_bgdreader",t,total_lines,total_bytes} );
+
+  t = time_best(repeats,[&]() {
+      for (size_t i=0; i<files.size(); ++i) {
+	ifstream bgdf( files[i].c_str() );
+	string bline;
+	while ( getline(bgdf,bline) ) {
+	  bgdline datapoint(bline);
+	}
+      }
+    });
+  print_result( benchresult{"parse_getline_bgdline",t,total_lines,total_bytes} );
+
+  // Kernels: each metric on profiles already in memory
+  vector<loadedprofile> loaded( files.size() );
+  for (size_t i=0; i<files.size(); ++i) {
+    loaded[i].reader = new bgdreader(files[i]);
+    loaded[i].target = trgnames[i];
+    bgdview datapoint;
+    while ( loaded[i].reader->next(datapoint) ) {
+      loaded[i].lines.push_back(datapoint);
+    }
+  }
+
+  vector<dirwindow> dirwindows( 1, dirwindow(3000,500000) );
+  vector<double> cutoffs( 1, 100000 );
+  vector<prpnwindow> windows = default_prpn_windows();
+
+  map<string, function<profilemetric*(const bedline&)> > kernels;
+  kernels["kernel_directionality"] = [&](const bedline &trg) -> profilemetric* {
+    return new dirmetric(trg,dirwindows); };
+  kernels["kernel_local_v_long"] = [&](const bedline &trg) -> profilemetric* {
+    return new loclongmetric(trg,1000,10000000,cutoffs,false); };
+  kernels["kernel_log_reads_v_separation"] = [&](const bedline &trg) -> profilemetric* {
+    return new logsepmetric(trg,0.25); };
+  kernels["kernel_read_stats"] = [&](const bedline &trg) -> profilemetric* {
+    return new statsmetric(trg,windows,0.0); };
+  kernels["kernel_read_stats_sketch"] = [&](const bedline &trg) -> profilemetric* {
+    return new statsmetric(trg,windows,0.001); };
+
+  for (map<string, function<profilemetric*(const bedline&)> >::const_iterator k=kernels.begin(); k!=kernels.end(); ++k) {
+    t = time_best(repeats,[&]() {
+	for (size_t i=0; i<loaded.size(); ++i) {
+	  profilemetric *metric = k->second( targets[loaded[i].target] );
+	  const vector<bgdview> &lines = loaded[i].lines;
+	  for (size_t l=0; l<lines.size(); ++l) {
+	    metric->add( lines[l] );
+	  }
+	  if ( statsmetric *st = dynamic_cast<statsmetric*>(metric) ) {
+	    // the box plot is found at the end
+	    vector< pair<double,double> > prpn;
+	    st->results(prpn);
+	  }
+	  delete metric;
+	}
+      });
+    print_result( benchresult{k->first,t,total_lines,total_bytes} );
+  }
+
+  for (size_t i=0; i<loaded.size(); ++i) {
+    loaded[i].lines.clear();
+    delete loaded[i].reader;
+  }
+
+  // Each tool from start to finish
+  inf.open("filelist.txt");
+  while ( getline(inf,line) ) {
+    istringstream sline(line);
+    string filename;
+    if ( sline>>filename ) {
+      list_bytes += file_size(filename);
+      bgdreader bgdf(filename);
+      bgdview datapoint;
+      while ( bgdf.next(datapoint) ) {
+	++list_lines;
+      }
+    }
+  }
+  inf.close();
+
+  stringstream jopt;
+  jopt<<" -j "<<nthreads;
+  int nreps=0;
+  string repdirs,
+    outdirs;
+  while ( true ) {
+    stringstream rep;
+    rep<<"rep"<<nreps+1;
+    struct stat st;
+    if ( stat(rep.str().c_str(),&st)!=0 ) {
+      break;
+    }
+    repdirs += " "+rep.str();
+    ++nreps;
+    outdirs += " -f "+rep.str()+" bench_out/"+rep.str();
+  }
+  string mkoutdirs="rm -rf bench_out && mkdir bench_out";
+  for (int r=1; r<=nreps; ++r) {
+    stringstream rep;
+    rep<<" bench_out/rep"<<r;
+    mkoutdirs += " && mkdir"+rep.str();
+  }
+
+  struct toolrun {
+    string name,
+      command;
+    long int lines,
+      bytes;
+  };
+  vector<toolrun> tools;
+  tools.push_back( toolrun{"tool_directionality",
+	"/directionality -t targets.bed -f filelist.txt -o bench_out/dir.dat"+jopt.str(),list_lines,list_bytes} );
+  tools.push_back( toolrun{"tool_local_v_long",
+	"/local_v_long -t targets.bed -f filelist.txt -o bench_out/ll.dat"+jopt.str(),list_lines,list_bytes} );
+  tools.push_back( toolrun{"tool_log_reads_v_separation",
+	"/log_reads_v_separation -t targets.bed -f filelist.txt -o bench_out/lrs.dat"+jopt.str(),list_lines,list_bytes} );
+  tools.push_back( toolrun{"tool_read_stats",
+	"/read_stats -t targets.bed -f filelist_withCond.txt -o bench_out/rs_"+jopt.str(),total_lines,total_bytes} );
+  tools.push_back( toolrun{"tool_profile_metrics",
+	"/profile_metrics -t targets.bed -f filelist_withCond.txt -o bench_out/pm_"
+	" -m directionality,local_v_long,log_reads_v_separation,read_stats"+jopt.str(),total_lines,total_bytes} );
+  if ( !files.empty() ) {
+    long int track_lines=0;
+    bgdreader bgdf(files[0]);
+    bgdview datapoint;
+    while ( bgdf.next(datapoint) ) {
+      ++track_lines;
+    }
+    tools.push_back( toolrun{"tool_directionality_track",
+	  "/directionality_track -i "+files[0]+" -o bench_out/track.bdg"+jopt.str(),track_lines,file_size(files[0])} );
+  }
+  if ( nreps>1 ) {
+    tools.push_back( toolrun{"tool_find_aretfacts",
+	  "/find_aretfacts"+outdirs+" -all -a 10"+jopt.str(),2*total_lines,total_bytes+raw_bytes} );
+  }
+
+  bool good=true;
+  for (size_t i=0; i<tools.size(); ++i) {
+    string command = mkoutdirs+" && "+bindir+tools[i].command+" > /dev/null";
+    t = time_best(repeats,[&]() {
+	if ( system( command.c_str() )!=0 ) {
+	  good = false;
+	}
+      });
+    // the time includes the shell and making the directories, which is small
+    print_result( benchresult{tools[i].name,t,tools[i].lines,tools[i].bytes} );
+  }
+
+  if ( !good ) {
+    cerr<<" ERROR : Not all of the tools ran successfully"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
+
+
+double time_best(const int &repeats,const function<void()> &job) {
+  // shortest wall clock time of several runs of job
+  double best=1e30;
+  for (int r=0; r<repeats; ++r) {
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    job();
+    chrono::duration<double> taken = chrono::steady_clock::now()-begin;
+    best = min( best, taken.count() );
+  }
+  return best;
+}
+
+
+void print_result(const benchresult &res) {
+  cout<<left<<setw(32)<<res.name<<right<<fixed
+      <<setprecision(4)<<setw(10)<<res.seconds
+      <<setprecision(0)<<setw(14)<<res.lines/res.seconds
+      <<setprecision(1)<<setw(10)<<res.bytes/1048576.0/res.seconds<<endl;
+  cout.unsetf(ios::fixed);
+  cout<<setprecision(6);
+}
+
+
+long int file_size(const string &file) {
+  struct stat st;
+  if ( stat(file.c_str(),&st)!=0 ) {
+    return 0;
+  }
+  return st.st_size;
+}
+
+
+long int check_profiles(const vector<string> &files,long int &nlines) {
+  // Compare each line from bgdreader::next() with bgdline(string)
+  long int bad=0;
+  for (size_t i=0; i<files.size(); ++i) {
+    bgdreader bgdf(files[i]);
+    ifstream inf( files[i].c_str() );
+    string line;
+    bgdview datapoint;
+    while ( getline(inf,line) ) {
+      size_t first = line.find_first_not_of(" \t");
+      if ( first==string::npos || line[first]=='#' ||
+	   line.compare(first,5,"track")==0 || line.compare(first,7,"browser")==0 ) {
+	continue;
+      }
+      bgdline ref(line);
+      ++nlines;
+      if ( !bgdf.next(datapoint) ) {
+	++bad;
+	break;
+      }
+      bgdline got(datapoint);
+      if ( got.chrom!=ref.chrom || got.start!=ref.start || got.end!=ref.end ||
+	   memcmp(&got.value,&ref.value,sizeof(double))!=0 ) {
+	++bad;
+      }
+    }
+    if ( bgdf.next(datapoint) ) {
+      ++bad;
+    }
+  }
+  return bad;
+}
+
+
+long int check_numbers(long int &nnumbers) {
+  // Compare parse_double() and parse_long() with strtod() and strtol() on
+  // numbers written in all the ways they might be, and some which are not
+  // numbers, checking the values bit for bit and where each stops
+  vector<string> tests = {"0","-0","+0","0.0","-0.0",".5","-.5","1.","1e","1e+","1e-",
+			  "1E5","1e-5","1e22","1e23","1e-22","1e-23","1e308","1e309","1e-324",
+			  "0e999999999","9007199254740992","9007199254740993",
+			  "123456789012345678901234567890","0.000000000000000000000000001",
+			  "00000000000000000000001.5","1.00000000000000000000000000001",
+			  "0x1p3","0X10","inf","-inf","nan","infinity","-","+",".","e5","",
+			  "12abc","3.5.6","1,5","2147483648","-9223372036854775808",
+			  "9223372036854775807","9223372036854775808","99999999999999999999",
+			  // signs and the edges of the exact path: 2^53, 10^22, 2^63
+			  "-1e22","-1e-22","+1e23","-1e-23","1e+22","-1E+23","-0e5","+.0",
+			  "9007199254740991","9007199254740994","-9007199254740992",
+			  "-9007199254740993","9007199254740991e22","9007199254740993e-22",
+			  "4503599627370497.5","123456789012345678e22","9223372036854775807e-23",
+			  "-9223372036854775809","0.9007199254740993e16",
+			  // long mantissas, ties and the limits of double
+			  "2.2250738585072011e-308","2.2250738585072014e-308","4.9e-324",
+			  "1.7976931348623157e308","1.7976931348623159e308",
+			  "9007199254740993.00000000000000000000000000000000000000000000000001",
+			  "0.1000000000000000055511151231257827021181583404541015625",
+			  "1797693134862315708145274237317043567981e269",
+			  // hex, inf and nan, which are left to strtod()
+			  "-0x10","0x1.8p-1","0x","-nan","NaN","nan(123)","INF","-infinity","infinit"};
+  mt19937_64 rng(42);
+  char buf[64];
+  for (int i=0; i<1000000; ++i) {
+    uint64_t r = rng();
+    switch ( i%5 ) {
+    case 0:
+      // integers, with signs and leading zeros
+      snprintf(buf,sizeof(buf),"%s%0*lld",r&1 ? "-" : (r&2 ? "+" : ""),int((r>>2)%20),
+	       (long long)(rng()>>(r>>8)%64));
+      break;
+    case 1:
+      // as the tools write values
+      snprintf(buf,sizeof(buf),"%.*g",int(1+(r%17)),double(rng()>>11)*1e-8);
+      break;
+    case 2:
+      // doubles of any size, in full
+      {
+	uint64_t bits = rng();
+	double d;
+	memcpy(&d,&bits,sizeof(double));
+	snprintf(buf,sizeof(buf),"%.*g",int(1+(r%20)),d);
+      }
+      break;
+    case 3:
+      snprintf(buf,sizeof(buf),"%.*e",int(r%25),double(rng()>>(r>>8)%64)*1e-6);
+      break;
+    default:
+      snprintf(buf,sizeof(buf),"%.*f",int(r%12),double(rng()>>(r>>8)%64)*1e-3);
+    }
+    tests.push_back(buf);
+  }
+
+  long int bad=0;
+  for (size_t i=0; i<tests.size(); ++i) {
+    const char *p = tests[i].c_str(),
+      *q;
+    char *e;
+    double got = parse_double(p,&q),
+      ref = strtod(p,&e);
+    if ( memcmp(&got,&ref,sizeof(double))!=0 || q!=e ) {
+      ++bad;
+    }
+    long int lgot = parse_long(p,&q),
+      lref = strtol(p,&e,10);
+    if ( lgot!=lref || q!=e ) {
+      ++bad;
+    }
+    ++nnumbers;
+  }
+  return bad;
+}
+
+
+long int check_scan(long int &nbuffers) {
+  // Lines which end exactly at the end of the buffer, with and without
+  // their newline, in every length up to a few chunks. scan_line() must
+  // split them as the stream would, or give them back to the caller when
+  // the newline is not in a whole chunk. Then files whose last line ends
+  // around a chunk boundary go through bgdreader::next() and its fallback.
+  long int bad=0;
+  mt19937_64 rng(7);
+  const char chars[] = "chr1.5e-\t ";
+  for (int len=0; len<=4*SCAN_CHUNK+1; ++len) {
+    for (int k=0; k<8; ++k) {
+      string line;
+      for (int i=0; i<len; ++i) {
+	line += chars[rng()%(sizeof(chars)-1)];
+      }
+      // the fields as the caller would find them
+      vector<int> refstart,
+	refend;
+      for (int i=0; i<len; ++i) {
+	bool in = line[i]!=' ' && line[i]!='\t',
+	  before = i>0 && line[i-1]!=' ' && line[i-1]!='\t';
+	if ( in && !before ) {
+	  refstart.push_back(i);
+	}
+	if ( in && (i+1==len || line[i+1]==' ' || line[i+1]=='\t') ) {
+	  refend.push_back(i+1);
+	}
+      }
+      for (int withnl=0; withnl<2; ++withnl) {
+	// a buffer which ends with the line
+	string buf = withnl ? line+"\n" : line;
+	const char *p = buf.data(),
+	  *bufend = p+buf.size();
+	linefields f;
+	bool ok = !buf.empty() && scan_line(p,bufend,SCAN_MAXFIELDS,f),
+	  whole = withnl && len<int(buf.size()/SCAN_CHUNK)*SCAN_CHUNK;
+	++nbuffers;
+	if ( ok!=whole ) {
+	  ++bad;
+	  continue;
+	}
+	if ( !ok ) {
+	  continue;
+	}
+	int nref = min( int(refstart.size()), SCAN_MAXFIELDS );
+	if ( f.eol!=p+len || f.n!=nref ) {
+	  ++bad;
+	  continue;
+	}
+	for (int i=0; i<nref; ++i) {
+	  if ( f.start[i]!=p+refstart[i] || f.end[i]!=p+refend[i] ) {
+	    ++bad;
+	    break;
+	  }
+	}
+      }
+    }
+  }
+
+  // A profile whose size is each value around whole chunks, ending with or
+  // without a newline
+  char tmpl[] = "/tmp/benchmarksXXXXXX";
+  int fd = mkstemp(tmpl);
+  if ( fd<0 ) {
+    return bad+1;
+  }
+  close(fd);
+  string file(tmpl);
+  vector<string> files(1,file);
+  for (int pad=0; pad<=2*SCAN_CHUNK; ++pad) {
+    for (int withnl=0; withnl<2; ++withnl) {
+      ofstream ouf( file.c_str(), ios::trunc );
+      ouf<<"chr1\t0\t100\t0.25\n"
+	 <<"chr1\t100\t200\t"<<string(pad,'0')<<"1.5e-3";
+      if ( withnl ) {
+	ouf<<"\n";
+      }
+      ouf.close();
+      long int nlines=0;
+      bad += check_profiles(files,nlines);
+      if ( nlines!=2 ) {
+	++bad;
+      }
+      ++nbuffers;
+    }
+  }
+  unlink(file.c_str());
+  return bad;
+}
+
+long int check_simd(long int &nchunks) {
+  // The masks of the selected SIMD version must be those of the portable
+  // one for any bytes, and scan_line() must split random lines of a few
+  // chunks the same way with either
+  long int bad=0;
+  mt19937_64 rng(11);
+  const char chars[] = "chr1.5e-\t \n";
+  string buf( 4*SCAN_CHUNK, ' ' );
+  for (int k=0; k<200000; ++k) {
+    // mostly bedGraph characters with few newlines, sometimes any bytes
+    bool anybyte = k%4==0;
+    for (size_t i=0; i<buf.size(); ++i) {
+      uint64_t r = rng();
+      buf[i] = anybyte ? char(r) : (r%64==0 ? '\n' : chars[r%(sizeof(chars)-2)]);
+    }
+    const char *p = buf.data(),
+      *bufend = p+buf.size();
+    for (const char *chunk=p; chunk+SCAN_CHUNK<=bufend; chunk+=SCAN_CHUNK) {
+      uint64_t sep,
+	nl,
+	refsep,
+	refnl;
+      scan_masks(chunk,sep,nl);
+      scan_masks_scalar(chunk,refsep,refnl);
+      if ( sep!=refsep || nl!=refnl ) {
+	++bad;
+      }
+      ++nchunks;
+    }
+    const char *from = p+rng()%SCAN_CHUNK;
+    linefields f,
+      ref;
+    bool ok = scan_line(from,bufend,SCAN_MAXFIELDS,f),
+      refok = scan_line_scalar(from,bufend,SCAN_MAXFIELDS,ref);
+    if ( ok!=refok || (ok && (f.eol!=ref.eol || f.n!=ref.n)) ) {
+      ++bad;
+      continue;
+    }
+    for (int j=0; ok && j<f.n; ++j) {
+      if ( f.start[j]!=ref.start[j] || f.end[j]!=ref.end[j] ) {
+	++bad;
+	break;
+      }
+    }
+  }
+  return bad;
+}
+
+
+long int check_sums(const vector<string> &files,const vector<string> &trgnames,
+		    map<string,bedline> &targets,long int &nwindows) {
+  // Compare dirmetric fed every line with dirmetric::add_sums(), to within
+  // the rounding of the cumulative sums
+  vector<dirwindow> windows;
+  windows.push_back( dirwindow(1000,100000) );
+  windows.push_back( dirwindow(3000,500000) );
+  windows.push_back( dirwindow(5000,2000000) );
+  windows.push_back( dirwindow(50000,10000000) );
+  long int bad=0;
+  for (size_t i=0; i<files.size(); ++i) {
+    const bedline &trg = targets[trgnames[i]];
+    profilesums sums;
+    string error;
+    if ( !sums.build(files[i],error) ) {
+      ++bad;
+      continue;
+    }
+    dirmetric direct(trg,windows),
+      fromsums(trg,windows);
+    bgdreader bgdf(files[i]);
+    bgdview datapoint;
+    while ( bgdf.next(datapoint) ) {
+      direct.add(datapoint);
+    }
+    fromsums.add_sums(sums);
+    vector< pair<double,double> > a = direct.results(),
+      b = fromsums.results();
+    for (size_t w=0; w<windows.size(); ++w) {
+      ++nwindows;
+      double d1 = fabs(a[w].first-b[w].first),
+	d2 = fabs(a[w].second-b[w].second);
+      if ( isnan(a[w].first)!=isnan(b[w].first) || d1>1e-9*max(1.0,fabs(a[w].first)) ||
+	   isnan(a[w].second)!=isnan(b[w].second) || d2>1e-9*max(1.0,fabs(a[w].second)) ) {
+	++bad;
+      }
+    }
+  }
+  return bad;
+}
+
+
+long int check_sketch(long int &nranks,double &worst) {
+  // Split a stream among several sketches, in blocks or interleaved, and
+  // merge them one after another or in pairs. The rank of each value given
+  // by at(), and each count_below(), is compared with the sorted stream; the
+  // error as a fraction of eps*n must be at most 1.
+  long int bad=0;
+  const double eps=0.01;
+  const size_t n=200000;
+  mt19937_64 rng(13);
+  for (int dist=0; dist<3; ++dist) {
+    // continuous values, a heavy tail, and many ties as in pile-ups
+    vector<double> values(n);
+    lognormal_distribution<double> tail(0.0,2.0);
+    for (size_t i=0; i<n; ++i) {
+      values[i] = dist==0 ? double(rng()>>11)/9007199254740992.0 : (dist==1 ? tail(rng) : double(rng()%50));
+    }
+    vector<double> exact(values);
+    sort( exact.begin(), exact.end() );
+    for (int parts=1; parts<=16; parts*=2) {
+      for (int how=0; how<2; ++how) {
+	vector<quantilesketch> sketches( parts, quantilesketch(eps) );
+	for (size_t i=0; i<n; ++i) {
+	  sketches[ how==0 ? i*parts/n : i%parts ].add( values[i] );
+	}
+	if ( how==0 ) {
+	  for (int p=1; p<parts; ++p) {
+	    sketches[0].merge( sketches[p] );
+	  }
+	} else {
+	  for (int step=1; step<parts; step*=2) {
+	    for (int p=0; p+step<parts; p+=2*step) {
+	      sketches[p].merge( sketches[p+step] );
+	    }
+	  }
+	}
+	const quantilesketch &S = sketches[0];
+	if ( S.count()!=n ) {
+	  ++bad;
+	  continue;
+	}
+	for (size_t r=0; r<n; r+=n/500) {
+	  // the exact ranks which the value at r covers
+	  double x = S.at(r);
+	  size_t lo = lower_bound( exact.begin(), exact.end(), x )-exact.begin(),
+	    hi = upper_bound( exact.begin(), exact.end(), x )-exact.begin();
+	  double err = r<lo ? double(lo-r) : (r>=hi ? double(r-hi+1) : 0.0);
+	  x = exact[r];
+	  size_t below = S.count_below(x);
+	  lo = lower_bound( exact.begin(), exact.end(), x )-exact.begin();
+	  err = max( err, fabs(double(below)-double(lo)) )/(eps*n);
+	  worst = max( worst, err );
+	  if ( err>1.0 ) {
+	    ++bad;
+	  }
+	  ++nranks;
+	}
+      }
+    }
+  }
+  return bad;
+}
+
+
+long int check_tools(const string &bindir,long int &ncases) {
+  // Run the tools on small inputs in bench_checks, checking that each case
+  // ends as it should and, where it matters, what it writes
+  long int bad=0;
+  vector< pair<string,bool> > cases;
+  if ( !run_quiet("rm -rf bench_checks && mkdir bench_checks") ) {
+    return 1;
+  }
+
+  // find_aretfacts: a replicate lacking the first chromosome of another
+  string fa = "bench_checks/fa";
+  run_quiet("mkdir "+fa+" "+fa+"/i1 "+fa+"/i2 "+fa+"/o1 "+fa+"/o2");
+  string rep1 = "chr2\t0\t100\t5\nchr2\t100\t200\t1\n",
+    rep2 = "chr1\t0\t100\t5\nchr2\t0\t100\t1\nchr2\t100\t200\t1\n",
+    args = " -f "+fa+"/i1 "+fa+"/o1 -f "+fa+"/i2 "+fa+"/o2 -t T";
+  write_text(fa+"/i1/captured_normalizedpileup_T.bdg",rep1);
+  write_text(fa+"/i1/captured_rawpileup_T.bdg",rep1);
+  write_text(fa+"/i2/captured_normalizedpileup_T.bdg",rep2);
+  write_text(fa+"/i2/captured_rawpileup_T.bdg",rep2);
+  cases.push_back( make_pair("find_aretfacts missing chromosome",
+			     run_quiet(bindir+"/find_aretfacts"+args+" -a 2") &&
+			     read_text(fa+"/o1/captured_rawpileup_T.bdg")=="chr2\t0\t100\t0\nchr2\t100\t200\t1\n" &&
+			     read_text(fa+"/o2/captured_rawpileup_T.bdg")=="chr1\t0\t100\t0\nchr2\t0\t100\t1\nchr2\t100\t200\t1\n") );
+
+  // and replicates with their chromosomes in different orders
+  run_quiet("rm -f "+fa+"/o1/* "+fa+"/o2/*");
+  write_text(fa+"/i1/captured_normalizedpileup_T.bdg","chr1\t0\t100\t5\nchr2\t0\t100\t1\n");
+  write_text(fa+"/i2/captured_normalizedpileup_T.bdg","chr2\t0\t100\t5\nchr1\t0\t100\t1\n");
+  cases.push_back( make_pair("find_aretfacts chromosome order",!run_quiet(bindir+"/find_aretfacts"+args+" -a 2")) );
+
+  // binary pile-ups, whose records are written out as bedGraph
+  run_quiet("rm -f "+fa+"/o1/* "+fa+"/o2/* "+fa+"/i1/* "+fa+"/i2/*");
+  write_text(fa+"/rep1.bdg","chr1\t0\t100\t20\nchr1\t100\t200\t1.25\n");
+  write_text(fa+"/rep2.bdg","chr1\t0\t100\t1\nchr1\t100\t200\t1\n");
+  for (int r=1; r<=2; ++r) {
+    stringstream in;
+    in<<fa<<"/rep"<<r<<".bdg -o "<<fa<<"/i"<<r;
+    run_quiet(bindir+"/bdg_to_binary -i "+in.str()+"/captured_normalizedpileup_T.bdg");
+    run_quiet(bindir+"/bdg_to_binary -i "+in.str()+"/captured_rawpileup_T.bdg");
+  }
+  cases.push_back( make_pair("find_aretfacts binary pile-ups",
+			     run_quiet(bindir+"/find_aretfacts"+args+" -a 10") &&
+			     read_text(fa+"/o1/captured_rawpileup_T.bdg")=="chr1\t0\t100\t0\nchr1\t100\t200\t1.25\n" &&
+			     read_text(fa+"/o2/captured_rawpileup_T.bdg")=="chr1\t0\t100\t1\nchr1\t100\t200\t1\n") );
+
+  // a BGZF profile with a tabix index, cut short: the target is skipped
+  string gz = "bench_checks/gz";
+  run_quiet("mkdir "+gz+" "+gz+"/i1 "+gz+"/i2 "+gz+"/o1 "+gz+"/o2");
+  stringstream profile;
+  for (int b=0; b<2000; ++b) {
+    profile<<"chr1\t"<<100*b<<"\t"<<100*b+100<<"\t"<<1+b%7<<"\n";
+  }
+  for (int r=1; r<=2; ++r) {
+    stringstream rep;
+    rep<<gz<<"/i"<<r;
+    write_text(rep.str()+"/captured_normalizedpileup_T.bdg",profile.str());
+    write_text(rep.str()+"/captured_rawpileup_T.bdg",profile.str());
+  }
+  run_quiet(bindir+"/find_aretfacts -f "+gz+"/i1 "+gz+"/o1 -f "+gz+"/i2 "+gz+"/o2 -t T -a 10 -z");
+  string whole = gz+"/o1/captured_rawpileup_T.bdg.gz",
+    text = read_text(whole);
+  run_quiet(bindir+"/index_bdg -i "+whole);
+  write_text(gz+"/cut.bdg.gz",text.substr(0,text.size()/2));
+  run_quiet("cp "+whole+".tbi "+gz+"/cut.bdg.gz.tbi");
+  write_text(gz+"/targets.bed","chr1\t100000\t100500\tT\t+\n");
+  write_text(gz+"/whole.txt",whole+"\tT\n");
+  write_text(gz+"/cut.txt",gz+"/cut.bdg.gz\tT\n");
+  cases.push_back( make_pair("directionality BGZF",
+			     run_quiet(bindir+"/directionality -t "+gz+"/targets.bed -f "+gz+"/whole.txt -o "+gz+"/dir_whole.dat") &&
+			     read_text(gz+"/dir_whole.dat").find("\tT\t")!=string::npos) );
+  cases.push_back( make_pair("directionality BGZF cut short",
+			     run_quiet(bindir+"/directionality -t "+gz+"/targets.bed -f "+gz+"/cut.txt -o "+gz+"/dir_cut.dat") &&
+			     read_text(gz+"/dir_cut.dat").find("\tT\t")==string::npos) );
+  write_text(gz+"/cut_cond.txt",gz+"/cut.bdg.gz\tC\tT\n");
+  cases.push_back( make_pair("local_v_long BGZF cut short",
+			     !run_quiet(bindir+"/local_v_long -t "+gz+"/targets.bed -f "+gz+"/cut.txt -o "+gz+"/ll_cut.dat")) );
+  write_text(gz+"/whole_cond.txt",whole+"\tC\tT\n");
+  cases.push_back( make_pair("read_stats window headers",
+			     run_quiet(bindir+"/read_stats -t "+gz+"/targets.bed -f "+gz+"/whole_cond.txt -o "+gz+"/rs_"
+				       " -w 0:10000000,5000000:12000000") &&
+			     read_text(gz+"/rs_prpn0to10M.dat").find("within the first 30Mb")!=string::npos &&
+			     read_text(gz+"/rs_prpn5to12M.dat").find("between 5000000 and 12000000 bp")!=string::npos) );
+  cases.push_back( make_pair("read_stats BGZF cut short",
+			     !run_quiet(bindir+"/read_stats -t "+gz+"/targets.bed -f "+gz+"/cut_cond.txt -o "+gz+"/rs_cut_")) );
+
+  // mask_target_regions: bins split around the padded target (chr2 300-800)
+  // and the chromosome blocks put in name order; a chromosome in two blocks
+  // stops the program
+  string mk = "bench_checks/mask";
+  run_quiet("mkdir "+mk+" "+mk+"/ok "+mk+"/bad");
+  write_text(mk+"/config.txt","BIN 100 200\nEXCLUDE 10\n");
+  write_text(mk+"/targets.bed","chr2\t500\t600\tP1\t+\n");
+  write_text(mk+"/ok/captured_bin_100_200_RPM_P1.bdg",
+	     "track type=bedGraph\nchrZ\t0\t100\t1\nchr2\t0\t100\t2\nchr2\t100\t400\t3\n"
+	     "chr2\t400\t500\t4\nchr2\t700\t900\t5\nchr10\t0\t100\t6\n");
+  write_text(mk+"/bad/captured_bin_100_200_RPM_P1.bdg",
+	     "chr2\t0\t100\t2\nchr10\t0\t100\t6\nchr2\t100\t400\t3\n");
+  string mkargs = " -c "+mk+"/config.txt -t "+mk+"/targets.bed -d ";
+  cases.push_back( make_pair("mask_target_regions sweep",
+			     run_quiet(bindir+"/mask_target_regions"+mkargs+mk+"/ok") &&
+			     read_text(mk+"/ok/masked_bin_100_200_RPM_P1.bdg")==
+			     "track type=bedGraph\nchr10\t0\t100\t6\nchr2\t0\t100\t2\nchr2\t100\t300\t3\n"
+			     "chr2\t100\t400\t-100\nchr2\t400\t500\t-100\nchr2\t700\t900\t-100\n"
+			     "chr2\t800\t900\t5\nchrZ\t0\t100\t1\n") );
+  cases.push_back( make_pair("mask_target_regions unsorted input",
+			     !run_quiet(bindir+"/mask_target_regions"+mkargs+mk+"/bad")) );
+
+  for (size_t c=0; c<cases.size(); ++c) {
+    ++ncases;
+    if ( !cases[c].second ) {
+      cerr<<" Check failed : "<<cases[c].first<<endl;
+      ++bad;
+    }
+  }
+  return bad;
+}
+
+
+void write_text(const string &file,const string &text) {
+  ofstream ouf( file.c_str() );
+  ouf<<text;
+}
+
+
+string read_text(const string &file) {
+  // the whole of a file, empty if it cannot be read
+  ifstream inf( file.c_str() );
+  stringstream text;
+  text<<inf.rdbuf();
+  return text.str();
+}
+
+
+bool run_quiet(const string &command) {
+  // run a command with its output discarded; true if it succeeds
+  return system( (command+" > /dev/null 2>&1").c_str() )==0;
+}
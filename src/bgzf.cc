@@ -0,0 +1,257 @@
+//***************************************************************************
+//
+// Functions for reading gzip and BGZF compressed files, and writing BGZF
+//
+//***************************************************************************
+
+#include<string>
+#include<vector>
+#include<cstring>
+#include<thread>
+#include<fstream>
+#include<stdint.h>
+#include <zlib.h>
+
+#include "bgzf.h"
+#include "parallel.h"
+
+using namespace std;
+
+
+static int gunzip_threads = max( 1, int(thread::hardware_concurrency()) );
+
+void set_job_threads(const int &n) {
+  // A tool running n jobs at once inflates each BGZF file on the thread of
+  // its job, so that it never has more than n threads; a single job uses
+  // every core for the blocks of one file
+  gunzip_threads = n>1 ? 1 : max( 1, int(thread::hardware_concurrency()) );
+}
+
+static uint16_t get16(const char *p) {
+  const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+  return u[0] | (u[1]<<8);
+}
+
+static uint32_t get32(const char *p) {
+  const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+  return u[0] | (u[1]<<8) | (u[2]<<16) | (uint32_t(u[3])<<24);
+}
+
+static void put16(char *p,const uint16_t &v) {
+  p[0] = v & 0xff;
+  p[1] = v>>8;
+}
+
+static void put32(char *p,const uint32_t &v) {
+  for (int i=0; i<4; ++i) {
+    p[i] = (v>>(8*i)) & 0xff;
+  }
+}
+
+bool is_gzip(const char *data,const size_t &size) {
+  return size>=18 && (unsigned char)data[0]==31 && (unsigned char)data[1]==139 && data[2]==8;
+}
+
+size_t bgzf_block_size(const char *data,const size_t &size) {
+  // Size of the BGZF block at data, or 0 if it is not one
+  if ( !is_gzip(data,size) || !(data[3]&4) ) {
+    return 0;
+  }
+  size_t xlen = get16(data+10);
+  if ( 12+xlen>size ) {
+    return 0;
+  }
+  for (size_t x=12; x+4<=12+xlen; x+=4+get16(data+x+2)) {
+    if ( data[x]=='B' && data[x+1]=='C' && get16(data+x+2)==2 ) {
+      size_t bsize = size_t(get16(data+x+4))+1;
+      return bsize<=size && bsize>=12+xlen+8 ? bsize : 0;
+    }
+  }
+  return 0;
+}
+
+bool is_bgzf(const char *data,const size_t &size) {
+  return bgzf_block_size(data,size)>0;
+}
+
+bool is_bgzf_file(const string &file) {
+  // test the first block of a file, which is at most 64KiB
+  vector<char> block(1<<16);
+  ifstream inf( file.c_str(), ios::binary );
+  inf.read(&block[0],block.size());
+  return is_bgzf(&block[0],inf.gcount());
+}
+
+bool bgzf_blocks(const char *data,const size_t &size,const size_t &from,const size_t &to,vector<bgzfblock> &blocks) {
+  // List the blocks which start from file offset from (the start of a block)
+  // up to to, with where their output goes if they are inflated one after
+  // the other. Returns false if anything there is not a BGZF block.
+  blocks.clear();
+  size_t pos=from,
+    total=0;
+  while ( pos<size && pos<=to ) {
+    size_t bsize = bgzf_block_size(data+pos,size-pos);
+    if ( bsize==0 ) {
+      return false;
+    }
+    bgzfblock b;
+    b.start = pos;
+    b.in = pos+12+get16(data+pos+10);
+    b.inlen = pos+bsize-8-b.in;
+    b.crc = get32(data+pos+bsize-8);
+    b.outlen = get32(data+pos+bsize-4);
+    b.out = total;
+    total += b.outlen;
+    blocks.push_back(b);
+    pos += bsize;
+  }
+  return true;
+}
+
+static bool inflate_raw(const char *in,const size_t &inlen,char *out,const size_t &outlen) {
+  // Inflate a raw deflate stream which must give exactly outlen bytes
+  z_stream zs;
+  memset(&zs,0,sizeof(zs));
+  if ( inflateInit2(&zs,-15)!=Z_OK ) {
+    return false;
+  }
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+  zs.avail_in = inlen;
+  zs.next_out = reinterpret_cast<Bytef*>(out);
+  zs.avail_out = outlen;
+  int ret = inflate(&zs,Z_FINISH);
+  bool ok = ret==Z_STREAM_END && zs.avail_out==0;
+  inflateEnd(&zs);
+  return ok;
+}
+
+bool bgzf_inflate(const char *data,const vector<bgzfblock> &blocks,string &out,string &error) {
+  // Inflate a list of blocks into out, one block per job on several threads
+  size_t total = blocks.empty() ? 0 : blocks.back().out+blocks.back().outlen;
+  out.assign(total,'\0');
+  vector<size_t> jobs( blocks.size() );
+  vector<char> ok( blocks.size(), 0 );
+  for (size_t i=0; i<blocks.size(); ++i) {
+    jobs[i] = i;
+  }
+  parallel_for( jobs, gunzip_threads, [&](const size_t &i) {
+      const bgzfblock &b = blocks[i];
+      char *dest = &out[0]+b.out;
+      if ( b.outlen==0 ) {
+	ok[i] = 1;
+      } else if ( inflate_raw(data+b.in,b.inlen,dest,b.outlen) ) {
+	ok[i] = crc32(0,reinterpret_cast<const Bytef*>(dest),b.outlen)==b.crc;
+      }
+    } );
+  for (size_t i=0; i<blocks.size(); ++i) {
+    if ( !ok[i] ) {
+      error = "corrupt BGZF block";
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool gunzip_serial(const char *data,const size_t &size,string &out,string &error) {
+  // Inflate a gzip file, which may have several members, in one stream
+  z_stream zs;
+  memset(&zs,0,sizeof(zs));
+  if ( inflateInit2(&zs,15+16)!=Z_OK ) {
+    error = "cannot start zlib";
+    return false;
+  }
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zs.avail_in = size;
+  vector<char> chunk(1<<18);
+  out.clear();
+  int ret=Z_OK;
+  while ( true ) {
+    zs.next_out = reinterpret_cast<Bytef*>(&chunk[0]);
+    zs.avail_out = chunk.size();
+    ret = inflate(&zs,Z_NO_FLUSH);
+    out.append( &chunk[0], chunk.size()-zs.avail_out );
+    if ( ret==Z_STREAM_END ) {
+      // another member may follow
+      if ( zs.avail_in==0 || !is_gzip(reinterpret_cast<const char*>(zs.next_in),zs.avail_in) ) {
+	break;
+      }
+      inflateReset(&zs);
+    } else if ( ret!=Z_OK ) {
+      break;
+    }
+  }
+  inflateEnd(&zs);
+  if ( ret!=Z_STREAM_END ) {
+    error = "corrupt or truncated gzip data";
+    return false;
+  }
+  return true;
+}
+
+bool gunzip(const char *data,const size_t &size,string &out,string &error) {
+  // Inflate a gzip file into out. A BGZF file is inflated a block at a time
+  // on several threads, the size of each block's output being in its
+  // trailer; anything else is inflated in one stream.
+  vector<bgzfblock> blocks;
+  if ( !bgzf_blocks(data,size,0,size,blocks) ) {
+    return gunzip_serial(data,size,out,error);
+  }
+  return bgzf_inflate(data,blocks,out,error);
+}
+
+
+bgzfdeflate::bgzfdeflate(const int &level) : zs(0), is_good(false) {
+  z_stream *s = new z_stream;
+  memset(s,0,sizeof(z_stream));
+  is_good = deflateInit2(s,level,Z_DEFLATED,-15,8,Z_DEFAULT_STRATEGY)==Z_OK;
+  zs = s;
+}
+
+bgzfdeflate::~bgzfdeflate() {
+  z_stream *s = static_cast<z_stream*>(zs);
+  if ( is_good ) {
+    deflateEnd(s);
+  }
+  delete s;
+}
+
+bool bgzfdeflate::compress(const char *p,size_t n,vector<char> &out) {
+  // Append the BGZF blocks for n bytes at p to out
+  z_stream *s = static_cast<z_stream*>(zs);
+  const size_t header=18,
+    trailer=8;
+  while ( n>0 && is_good ) {
+    size_t len = min( n, size_t(BGZF_BLOCK_INPUT) ),
+      start = out.size(),
+      room = deflateBound(s,len);
+    out.resize( start+header+room+trailer );
+    char *h = &out[start];
+    const char fixed[16] = {31,-117,8,4,0,0,0,0,0,-1,6,0,'B','C',2,0};
+    memcpy(h,fixed,16);
+
+    deflateReset(s);
+    s->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(p));
+    s->avail_in = len;
+    s->next_out = reinterpret_cast<Bytef*>(h+header);
+    s->avail_out = room;
+    if ( deflate(s,Z_FINISH)!=Z_STREAM_END ) {
+      is_good = false;
+      break;
+    }
+    size_t clen = room-s->avail_out,
+      bsize = header+clen+trailer;
+    put16(h+16,bsize-1);
+    put32(h+header+clen,crc32(0,reinterpret_cast<const Bytef*>(p),len));
+    put32(h+header+clen+4,len);
+    out.resize(start+bsize);
+    p += len;
+    n -= len;
+  }
+  return is_good;
+}
+
+void bgzfdeflate::eof(vector<char> &out) {
+  // the empty block which marks the end of a BGZF file
+  const unsigned char block[28] = {31,139,8,4,0,0,0,0,0,255,6,0,66,67,2,0,27,0,3,0,0,0,0,0,0,0,0,0};
+  out.insert( out.end(), block, block+28 );
+}
@@ -0,0 +1,61 @@
+//***************************************************************************
+//
+// Header for
+// Functions for reading gzip and BGZF compressed files, and writing BGZF
+//
+//***************************************************************************
+
+#ifndef BGZF_H
+#define BGZF_H
+
+#include<string>
+#include<vector>
+#include<cstddef>
+
+using namespace std;
+
+// BGZF is gzip made of independent blocks of at most 64KiB, each a gzip
+// member with the compressed size in an extra field, ending with an empty
+// block. It can be read by gunzip, and blocks can be inflated separately.
+#define BGZF_BLOCK_INPUT 0xff00       // bytes of input per block written
+
+struct bgzfblock {
+  // Where a block is in the compressed file and where its output goes
+  size_t start,     // file offset of the block
+    in,             // file offset of the deflate data
+    inlen,
+    out,            // offset of the output from the first block listed
+    outlen;
+  unsigned int crc;
+};
+
+bool is_gzip(const char*,const size_t&);
+bool is_bgzf(const char*,const size_t&);
+bool is_bgzf_file(const string&);
+size_t bgzf_block_size(const char*,const size_t&);
+
+bool gunzip(const char*,const size_t&,string&,string&);
+bool bgzf_blocks(const char*,const size_t&,const size_t&,const size_t&,vector<bgzfblock>&);
+bool bgzf_inflate(const char*,const vector<bgzfblock>&,string&,string&);
+
+void set_job_threads(const int&);
+
+
+class bgzfdeflate {
+  // Compresses data into BGZF blocks, reusing one deflate stream
+public:
+  bgzfdeflate(const int &level=6);
+  ~bgzfdeflate();
+  bool good() const { return is_good; }
+  bool compress(const char*,size_t,vector<char>&);
+  static void eof(vector<char>&);
+
+private:
+  bgzfdeflate(const bgzfdeflate&);
+  bgzfdeflate& operator=(const bgzfdeflate&);
+
+  void *zs;   // z_stream, kept out of the header
+  bool is_good;
+};
+
+#endif
@@ -0,0 +1,350 @@
+//***************************************************************************
+//
+// Reading bigWig files, without the UCSC library
+//
+//***************************************************************************
+
+#include<string>
+#include<vector>
+#include<cstring>
+#include<algorithm>
+#include<stdint.h>
+#include <zlib.h>
+
+#include "bigwig.h"
+#include "bedfiles.h"
+
+using namespace std;
+
+
+#define BPT_MAGIC 0x78CA8C91     // chromosome B+ tree
+#define RTREE_MAGIC 0x2468ACE0   // R-tree of blocks
+#define MAX_DEPTH 64             // of either tree, so a bad file cannot loop
+
+template<class T> static T get(const char *p) {
+  T v;
+  memcpy(&v,p,sizeof(T));
+  return v;
+}
+
+
+bool bigwig::is_bigwig(const char *data,const size_t &size) {
+  return size>=64 && get<uint32_t>(data)==BIGWIG_MAGIC;
+}
+
+bool bigwig::load(const char *d,const size_t &s) {
+  // Read the header, zoom headers and chromosome names from a buffer
+  // holding the whole file. Returns false if it is truncated or corrupt.
+  data = d;
+  size = s;
+  if ( !is_bigwig(data,size) ) {
+    return false;
+  }
+  version = get<uint16_t>(data+4);
+  uint16_t nzoom = get<uint16_t>(data+6);
+  chrom_tree = get<uint64_t>(data+8);
+  data_index = get<uint64_t>(data+24);
+  total_summary = get<uint64_t>(data+44);
+  bufsize = get<uint32_t>(data+52);
+  if ( 64+24*size_t(nzoom)>size ) {
+    return false;
+  }
+  zooms.clear();
+  for (uint16_t z=0; z<nzoom; ++z) {
+    zoomlevel zl;
+    zl.reduction = get<uint32_t>(data+64+24*z);
+    zl.index = get<uint64_t>(data+64+24*z+16);
+    if ( zl.index+48>size || get<uint32_t>(data+zl.index)!=RTREE_MAGIC ) {
+      return false;
+    }
+    zooms.push_back(zl);
+  }
+
+  if ( chrom_tree+32>size || get<uint32_t>(data+chrom_tree)!=BPT_MAGIC ||
+       data_index+48>size || get<uint32_t>(data+data_index)!=RTREE_MAGIC ) {
+    return false;
+  }
+  names.clear();
+  sizes.clear();
+  if ( !read_chroms(chrom_tree+32,get<uint32_t>(data+chrom_tree+8),0) ) {
+    return false;
+  }
+  seek("");
+  return true;
+}
+
+bool bigwig::read_chroms(const uint64_t &node,const uint32_t &keysize,const int &depth) {
+  // Walk the B+ tree from node, putting each name at its id
+  if ( depth>MAX_DEPTH || node+4>size ) {
+    return false;
+  }
+  bool leaf = data[node]!=0;
+  uint16_t count = get<uint16_t>(data+node+2);
+  size_t itemsize = keysize+8,
+    pos = node+4;
+  if ( pos+count*itemsize>size ) {
+    return false;
+  }
+  for (uint16_t i=0; i<count; ++i, pos+=itemsize) {
+    if ( leaf ) {
+      uint32_t id = get<uint32_t>(data+pos+keysize);
+      if ( id>=names.size() ) {
+	names.resize(id+1);
+	sizes.resize(id+1,0);
+      }
+      names[id] = string( data+pos, strnlen(data+pos,keysize) );
+      sizes[id] = get<uint32_t>(data+pos+keysize+4);
+    } else if ( !read_chroms(get<uint64_t>(data+pos+keysize),keysize,depth+1) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool bigwig::find_blocks(const uint64_t &node,const uint64_t &qstart,const uint64_t &qend,
+			 const int &depth,vector<blockref> &found) const {
+  // Blocks of the R-tree from node overlapping [qstart,qend), where a
+  // position is (chromosome id<<32)|base
+  if ( depth>MAX_DEPTH || node+4>size ) {
+    return false;
+  }
+  bool leaf = data[node]!=0;
+  uint16_t count = get<uint16_t>(data+node+2);
+  size_t itemsize = leaf ? 32 : 24,
+    pos = node+4;
+  if ( pos+count*itemsize>size ) {
+    return false;
+  }
+  for (uint16_t i=0; i<count; ++i, pos+=itemsize) {
+    uint64_t start = (uint64_t(get<uint32_t>(data+pos))<<32) | get<uint32_t>(data+pos+4),
+      end = (uint64_t(get<uint32_t>(data+pos+8))<<32) | get<uint32_t>(data+pos+12);
+    if ( start>=qend || end<=qstart ) {
+      continue;
+    }
+    if ( leaf ) {
+      blockref b;
+      b.offset = get<uint64_t>(data+pos+16);
+      b.size = get<uint64_t>(data+pos+24);
+      found.push_back(b);
+    } else if ( !find_blocks(get<uint64_t>(data+pos+16),qstart,qend,depth+1,found) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool bigwig::inflate_block(const blockref &b,string &out) const {
+  // A block is zlib compressed unless the header gives no buffer size
+  if ( b.offset+b.size>size ) {
+    return false;
+  }
+  if ( bufsize==0 ) {
+    out.assign(data+b.offset,b.size);
+    return true;
+  }
+  out.resize(bufsize);
+  uLongf len = bufsize;
+  if ( uncompress(reinterpret_cast<Bytef*>(&out[0]),&len,
+		  reinterpret_cast<const Bytef*>(data+b.offset),b.size)!=Z_OK ) {
+    return false;
+  }
+  out.resize(len);
+  return true;
+}
+
+bool bigwig::read_items(const blockref &b,vector<bwitem> &found) const {
+  // Items of the sections in a data block
+  string buf;
+  found.clear();
+  if ( !inflate_block(b,buf) ) {
+    return false;
+  }
+  const char *p = buf.data(),
+    *end = p+buf.size();
+  while ( p+24<=end ) {
+    uint32_t chr = get<uint32_t>(p),
+      start = get<uint32_t>(p+4),
+      step = get<uint32_t>(p+12),
+      span = get<uint32_t>(p+16);
+    uint8_t type = p[20];
+    uint16_t count = get<uint16_t>(p+22);
+    size_t itemsize = type==1 ? 12 : type==2 ? 8 : 4;
+    p += 24;
+    if ( type<1 || type>3 || p+count*itemsize>end ) {
+      return false;
+    }
+    for (uint16_t i=0; i<count; ++i, p+=itemsize) {
+      bwitem it;
+      it.chrom = chr;
+      if ( type==1 ) {
+	// bedGraph
+	it.start = get<uint32_t>(p);
+	it.end = get<uint32_t>(p+4);
+	it.value = get<float>(p+8);
+      } else if ( type==2 ) {
+	// varStep
+	it.start = get<uint32_t>(p);
+	it.end = it.start+span;
+	it.value = get<float>(p+4);
+      } else {
+	// fixedStep
+	it.start = start+i*step;
+	it.end = it.start+span;
+	it.value = get<float>(p);
+      }
+      found.push_back(it);
+    }
+  }
+  return true;
+}
+
+size_t bigwig::find_chrom(const string &name) const {
+  return find(names.begin(),names.end(),name)-names.begin();
+}
+
+void bigwig::seek(const string &name,const long int &f,const long int &t) {
+  // Restrict next() to items overlapping [f,t] on chromosome name, or
+  // give the whole file if name is empty
+  uint64_t qstart=0,
+    qend=UINT64_MAX;
+  chrom = UINT32_MAX;
+  if ( !name.empty() ) {
+    chrom = find_chrom(name);
+    from = max( f, 0L );
+    to = min( t, long(UINT32_MAX-1) );
+    qstart = (uint64_t(chrom)<<32) | from;
+    qend = (uint64_t(chrom)<<32) | (to+1);
+  }
+  blocks.clear();
+  if ( chrom<names.size() || name.empty() ) {
+    find_blocks(data_index+48,qstart,qend,0,blocks);
+  }
+  sort(blocks.begin(),blocks.end());
+  block = 0;
+  items.clear();
+  item = 0;
+}
+
+bool bigwig::next(bgdview &v) {
+  // Get the next item, inflating the next block when one is used up
+  while ( true ) {
+    while ( item<items.size() ) {
+      const bwitem &it = items[item++];
+      if ( it.chrom>=names.size() ||
+	   ( chrom!=UINT32_MAX && (it.chrom!=chrom || it.end<from || it.start>to) ) ) {
+	continue;
+      }
+      v.chrom.ptr = names[it.chrom].data();
+      v.chrom.len = names[it.chrom].size();
+      v.start = it.start;
+      v.end = it.end;
+      v.value = it.value;
+      return true;
+    }
+    if ( block>=blocks.size() || !read_items(blocks[block++],items) ) {
+      return false;
+    }
+    item = 0;
+  }
+}
+
+void bigwig::add_items(const uint32_t &chr,const uint32_t &lo,const uint32_t &hi,bigwigsummary &s) const {
+  // add the parts of the items on chr which are in [lo,hi)
+  vector<blockref> found;
+  vector<bwitem> its;
+  if ( lo>=hi ) {
+    return;
+  }
+  find_blocks(data_index+48,(uint64_t(chr)<<32)|lo,(uint64_t(chr)<<32)|hi,0,found);
+  sort(found.begin(),found.end());
+  for (size_t b=0; b<found.size(); ++b) {
+    read_items(found[b],its);
+    for (size_t i=0; i<its.size(); ++i) {
+      double bases = double(min(its[i].end,hi))-double(max(its[i].start,lo));
+      if ( its[i].chrom==chr && bases>0 ) {
+	s.bases += bases;
+	s.sum += its[i].value*bases;
+	s.sumsq += double(its[i].value)*its[i].value*bases;
+      }
+    }
+  }
+}
+
+bool bigwig::summary(const string &name,long int f,long int t,bigwigsummary &s) const {
+  // Values in [f,t) of chromosome name, weighted by the bases they cover.
+  // The coarsest zoom level with at least four records in the range is
+  // used for the records which lie inside it; the items are read for the
+  // ends it leaves. Zoom records keep their sums as floats, so the result
+  // can differ from the sum of the items in about the 7th digit.
+  s = bigwigsummary();
+  size_t chr = find_chrom(name);
+  if ( chr==names.size() ) {
+    return false;
+  }
+  f = max( f, 0L );
+  t = min( t, long(sizes[chr]) );
+  if ( f>=t ) {
+    return true;
+  }
+  const zoomlevel *zl=0;
+  for (size_t z=0; z<zooms.size(); ++z) {
+    if ( 4*long(zooms[z].reduction)<=t-f && (zl==0 || zooms[z].reduction>zl->reduction) ) {
+      zl = &zooms[z];
+    }
+  }
+
+  // records are disjoint, so those inside [f,t) cover one run [lo,hi)
+  uint32_t lo=t,
+    hi=f;
+  if ( zl ) {
+    vector<blockref> found;
+    string buf;
+    find_blocks(zl->index+48,(uint64_t(chr)<<32)|f,(uint64_t(chr)<<32)|t,0,found);
+    for (size_t b=0; b<found.size(); ++b) {
+      if ( !inflate_block(found[b],buf) ) {
+	return false;
+      }
+      for (size_t r=0; r+32<=buf.size(); r+=32) {
+	const char *p = buf.data()+r;
+	uint32_t rchrom = get<uint32_t>(p),
+	  rstart = get<uint32_t>(p+4),
+	  rend = get<uint32_t>(p+8);
+	if ( rchrom==chr && rstart>=f && rend<=t ) {
+	  s.bases += get<uint32_t>(p+12);
+	  s.sum += get<float>(p+24);
+	  s.sumsq += get<float>(p+28);
+	  lo = min(lo,rstart);
+	  hi = max(hi,rend);
+	}
+      }
+    }
+  }
+  if ( lo<hi ) {
+    add_items(chr,f,lo,s);
+    add_items(chr,hi,t,s);
+  } else {
+    add_items(chr,f,t,s);
+  }
+  return true;
+}
+
+bool bigwig::total(bigwigsummary &s) const {
+  // Over the whole file, from the total summary if there is one
+  s = bigwigsummary();
+  if ( version>=2 && total_summary>0 && total_summary+40<=size ) {
+    s.bases = get<uint64_t>(data+total_summary);
+    s.sum = get<double>(data+total_summary+24);
+    s.sumsq = get<double>(data+total_summary+32);
+    return true;
+  }
+  for (size_t c=0; c<names.size(); ++c) {
+    bigwigsummary cs;
+    if ( !summary(names[c],0,sizes[c],cs) ) {
+      return false;
+    }
+    s.bases += cs.bases;
+    s.sum += cs.sum;
+    s.sumsq += cs.sumsq;
+  }
+  return true;
+}
@@ -0,0 +1,106 @@
+//***************************************************************************
+//
+// Header for
+// Reading bigWig files, without the UCSC library
+//
+//***************************************************************************
+
+#ifndef BIGWIG_H
+#define BIGWIG_H
+
+#include<string>
+#include<vector>
+#include<cstddef>
+#include<stdint.h>
+
+#include "bedfiles.h"
+
+using namespace std;
+
+// File layout (little endian, as written on all common platforms):
+//   header       magic, version, number of zoom levels, offsets of the
+//                chromosome B+ tree, the data, the data R-tree and the
+//                total summary, and the size of an inflated block
+//   zoom headers for each level: bases per summary record, offsets of its
+//                records and of its R-tree
+//   B+ tree      chromosome name -> id and size
+//   data         zlib compressed blocks, each a section of bedGraph,
+//                varStep or fixedStep items on one chromosome
+//   R-trees      (chromosome,base) ranges -> blocks, one for the data and
+//                one for each zoom level, whose blocks hold 32 byte summary
+//                records (chromosome, start, end, bases covered, min, max,
+//                sum and sum of squares of value times bases)
+
+#define BIGWIG_MAGIC 0x888FFC26
+
+struct bigwigsummary {
+  // values over a range weighted by the bases they cover
+  double bases,
+    sum,
+    sumsq;
+  bigwigsummary() : bases(0.0), sum(0.0), sumsq(0.0) {};
+};
+
+
+class bigwig {
+  // Read only view of a bigWig file held in memory. next() gives the items
+  // of the whole file (by chromosome id, which is name order), or those
+  // overlapping the range given to seek(), found through the R-tree.
+  // summary() uses the zoom level records which fit inside the range, and
+  // the items only for the ends which they do not cover.
+public:
+  bigwig() : data(0), size(0), chrom(UINT32_MAX), from(0), to(0), block(0), item(0) {};
+  static bool is_bigwig(const char*,const size_t&);
+  bool load(const char*,const size_t&);
+  void seek(const string&,const long int &from=0,const long int &to=LONG_MAX);
+  bool next(bgdview&);
+  bool has_zoom() const { return !zooms.empty(); }
+  bool summary(const string&,long int,long int,bigwigsummary&) const;
+  bool total(bigwigsummary&) const;
+  vector<string> names;
+  vector<uint32_t> sizes;
+
+private:
+  struct zoomlevel {
+    uint32_t reduction;
+    uint64_t index;
+  };
+  struct blockref {
+    uint64_t offset,
+      size;
+    bool operator<(const blockref &b) const { return offset<b.offset; }
+  };
+  struct bwitem {
+    uint32_t chrom,
+      start,
+      end;
+    float value;
+  };
+
+  bool read_chroms(const uint64_t&,const uint32_t&,const int&);
+  bool find_blocks(const uint64_t&,const uint64_t&,const uint64_t&,const int&,vector<blockref>&) const;
+  bool inflate_block(const blockref&,string&) const;
+  bool read_items(const blockref&,vector<bwitem>&) const;
+  void add_items(const uint32_t&,const uint32_t&,const uint32_t&,bigwigsummary&) const;
+  size_t find_chrom(const string&) const;
+
+  const char *data;
+  size_t size;
+  uint32_t version,
+    bufsize;
+  uint64_t chrom_tree,
+    data_index,
+    total_summary;
+  vector<zoomlevel> zooms;
+
+  // position of next(), and the range set by seek()
+  uint32_t chrom,
+    from,
+    to;
+  vector<blockref> blocks;
+  size_t block;
+  vector<bwitem> items;
+  size_t item;
+};
+
+#endif
@@ -0,0 +1,163 @@
+//***************************************************************************
+//
+// Binary columnar format for bedGraph profiles
+//
+//***************************************************************************
+
+#include<string>
+#include<vector>
+#include<map>
+#include<fstream>
+#include<cstring>
+#include<stdint.h>
+
+#include "binprofile.h"
+#include "bedfiles.h"
+#include "runreport.h"
+
+using namespace std;
+
+
+static size_t pad8(const size_t &n) {
+  return (n+7) & ~size_t(7);
+}
+
+
+bool binprofile::is_binprofile(const char *data,const size_t &size) {
+  return size>=8 && memcmp(data,BINPROFILE_MAGIC,8)==0;
+}
+
+bool binprofile::load(const char *data,const size_t &size) {
+  // Set up the chromosome table from a buffer holding the whole file.
+  // Returns false if the file is truncated or has the wrong version.
+  uint32_t version,
+    nchrom;
+  size_t pos=8;
+
+  if ( !is_binprofile(data,size) || size<32 ) {
+    return false;
+  }
+  memcpy(&version,data+pos,4); pos+=4;
+  memcpy(&nchrom,data+pos,4); pos+=4;
+  memcpy(&nrecords,data+pos,8); pos+=8;
+  memcpy(&binsize,data+pos,8); pos+=8;
+  if ( version!=BINPROFILE_VERSION ) {
+    return false;
+  }
+
+  chroms.clear();
+  for (uint32_t c=0; c<nchrom; ++c) {
+    binchrom chr;
+    uint64_t offset;
+    uint32_t namelen;
+    if ( pos+20>size ) {
+      return false;
+    }
+    memcpy(&chr.n,data+pos,8); pos+=8;
+    memcpy(&offset,data+pos,8); pos+=8;
+    memcpy(&namelen,data+pos,4); pos+=4;
+    if ( pos+namelen>size || offset+chr.n*24>size ) {
+      return false;
+    }
+    chr.name.ptr = data+pos;
+    chr.name.len = namelen;
+    pos = pad8(pos+namelen);
+    chr.start = reinterpret_cast<const int64_t*>(data+offset);
+    chr.end = chr.start+chr.n;
+    chr.value = reinterpret_cast<const double*>(chr.end+chr.n);
+    chroms.push_back(chr);
+  }
+  return true;
+}
+
+
+bool write_binprofile(const string &infile,const string &outfile) {
+  // Convert a text bedGraph into a binary profile
+  vector<string> names;
+  map<string,size_t> index;
+  vector< vector<int64_t> > starts,
+    ends;
+  vector< vector<double> > values;
+  uint64_t nrecords=0;
+  int64_t binsize=-1;
+
+  bgdreader bgdf(infile);
+  if ( !bgdf.good() ) {
+    return false;
+  }
+  double begin = run_report.enabled() ? runreport::now() : 0.0;
+  bgdview datapoint;
+  string last;
+  size_t c=0;
+  while ( bgdf.next(datapoint) ) {
+    if ( nrecords==0 || last!=datapoint.chrom ) {
+      last = datapoint.chrom.str();
+      if ( index.count(last)==0 ) {
+	index[last] = names.size();
+	names.push_back(last);
+	starts.push_back( vector<int64_t>() );
+	ends.push_back( vector<int64_t>() );
+	values.push_back( vector<double>() );
+      }
+      c = index[last];
+    }
+    starts[c].push_back(datapoint.start);
+    ends[c].push_back(datapoint.end);
+    values[c].push_back(datapoint.value);
+    if ( binsize==-1 ) {
+      binsize = datapoint.end-datapoint.start;
+    } else if ( binsize!=datapoint.end-datapoint.start ) {
+      binsize = 0;
+    }
+    nrecords++;
+  }
+  if ( !bgdf.good() ) {
+    return false;
+  }
+  if ( binsize==-1 ) {
+    binsize = 0;
+  }
+  if ( run_report.enabled() ) {
+    run_report.add_file(infile,bgdf.tell(),nrecords,runreport::now()-begin);
+  }
+
+  // work out where everything goes
+  uint32_t nchrom = names.size(),
+    version = BINPROFILE_VERSION;
+  size_t pos = 32;
+  for (size_t i=0; i<names.size(); ++i) {
+    pos = pad8(pos+20+names[i].size());
+  }
+  vector<uint64_t> offsets;
+  for (size_t i=0; i<names.size(); ++i) {
+    offsets.push_back(pos);
+    pos += 24*starts[i].size();
+  }
+
+  ofstream ouf( outfile.c_str(), ios::binary );
+  if ( !ouf.good() ) {
+    return false;
+  }
+  const char zeros[8]={0,0,0,0,0,0,0,0};
+  ouf.write(BINPROFILE_MAGIC,8);
+  ouf.write(reinterpret_cast<const char*>(&version),4);
+  ouf.write(reinterpret_cast<const char*>(&nchrom),4);
+  ouf.write(reinterpret_cast<const char*>(&nrecords),8);
+  ouf.write(reinterpret_cast<const char*>(&binsize),8);
+  for (size_t i=0; i<names.size(); ++i) {
+    uint64_t n = starts[i].size();
+    uint32_t namelen = names[i].size();
+    ouf.write(reinterpret_cast<const char*>(&n),8);
+    ouf.write(reinterpret_cast<const char*>(&offsets[i]),8);
+    ouf.write(reinterpret_cast<const char*>(&namelen),4);
+    ouf.write(names[i].data(),namelen);
+    ouf.write(zeros,pad8(20+namelen)-(20+namelen));
+  }
+  for (size_t i=0; i<names.size(); ++i) {
+    ouf.write(reinterpret_cast<const char*>(starts[i].data()),8*starts[i].size());
+    ouf.write(reinterpret_cast<const char*>(ends[i].data()),8*ends[i].size());
+    ouf.write(reinterpret_cast<const char*>(values[i].data()),8*values[i].size());
+  }
+  ouf.close();
+  return ouf.good();
+}
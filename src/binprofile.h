@@ -0,0 +1,58 @@
+//***************************************************************************
+//
+// Header for 
+// Binary columnar format for bedGraph profiles
+//
+//***************************************************************************
+
+#ifndef BINPROFILE_H
+#define BINPROFILE_H
+
+#include<string>
+#include<vector>
+#include<cstddef>
+#include<stdint.h>
+
+#include "bedfiles.h"
+
+using namespace std;
+
+// File layout (native byte order, all sections 8 byte aligned):
+//   header      magic "CCBDGBIN", uint32 version, uint32 nchrom,
+//               uint64 nrecords, int64 binsize (0 if bins are not all
+//               the same width)
+//   dictionary  for each chromosome: uint64 nrecords, uint64 offset,
+//               uint32 namelen, name (padded)
+//   data        for each chromosome, at offset: int64 start[n],
+//               int64 end[n], double value[n]
+// Chromosomes are stored in the order they first appear in the bedGraph,
+// and records keep their order within a chromosome.
+
+#define BINPROFILE_MAGIC "CCBDGBIN"
+#define BINPROFILE_VERSION 1
+
+struct binchrom {
+  // one chromosome of a binary profile, pointing into the mapped file
+  strview name;
+  uint64_t n;
+  const int64_t *start,
+    *end;
+  const double *value;
+};
+
+
+class binprofile {
+  // Read only view of a binary profile held in memory
+public:
+  binprofile() : binsize(0), nrecords(0) {};
+  static bool is_binprofile(const char*,const size_t&);
+  bool load(const char*,const size_t&);
+  int64_t binsize;
+  uint64_t nrecords;
+  vector<binchrom> chroms;
+};
+
+
+bool write_binprofile(const string&,const string&);
+
+#endif
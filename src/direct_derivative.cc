@@ -15,6 +15,7 @@
 #include<sstream>
 
 #include "bedfiles.h"
+#include "runreport.h"
 
 using namespace std;
 
@@ -23,9 +24,12 @@ int main(int argc, char *argv[]) {
   // get options from command line
   if (argc<5) {
     cout<<"Usage :"<<endl;
-    cout<<"       ./direct_derivative -d directionalityfile -o outputfile"<<endl;
+    cout<<"       ./direct_derivative -d directionalityfile -o outputfile [-bdg] [--profile report]"<<endl;
     cout<<"where       directionalityfile  is a ."<<endl;
+    cout<<"            -bdg         OPTIONAL: the file is a bedGraph (e.g. from directionality_track), which may"<<endl;
+    cout<<"                         have several chromosomes; derivatives are found within each."<<endl;
     cout<<"            outfile      is a file name for the output."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
     cout<<endl;
     exit(EXIT_FAILURE);
   }
@@ -34,6 +38,9 @@ int main(int argc, char *argv[]) {
     inputslist,
     outputfile;
 
+  string profilefile;
+  bool bedgraph=false;
+
   int argi=1;
   while (argi < argc) {
 
@@ -55,6 +62,20 @@ int main(int argc, char *argv[]) {
       outputfile = string(argv[argi+1]);
       argi += 2;
 
+    } else if ( string(argv[argi]) == "-bdg" ) {
+      // input is a bedGraph
+      bedgraph = true;
+      argi += 1;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
     } else {
       cerr<<"Error parsing command line (unrecognised option)"<<endl;
       exit(EXIT_FAILURE);
@@ -62,33 +83,37 @@ int main(int argc, char *argv[]) {
 
   }
 
+  if ( !profilefile.empty() && !run_report.open(profilefile,"direct_derivative",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
   // Set up variables
   ifstream inf;
-  ofstream ouf;
+  bgdwriter ouf;
   set<bgdline> targets;
   typedef set<bgdline>::const_iterator targit;
 
-  string line;
-  stringstream sline;
-    
-  
-  // Read the dir file
-  inf.open( dirfile.c_str() );
-  if ( !inf.good() ) {
+  // Read the dir file (directionality is in the fifth column, or the fourth
+  // of a bedGraph)
+  run_report.phase("load_targets");
+  bgdreader bgdf( dirfile, bedgraph ? 3 : 4 );
+  if ( !bgdf.good() ) {
     cerr<<" ERROR : Cannot open file "<<dirfile<<endl;
     exit(EXIT_FAILURE);
   }
-  while ( getline(inf,line) ) {
-    if ( line.compare(0,1,"#")!=0 ) {
-      string chrom,junk;
-      long int start, end;
-      double dir;
-      sline.clear(); sline.str(line);
-      sline>>chrom>>start>>end>>junk>>dir;
-      targets.insert( bgdline(chrom,start,end,dir)  );
-    }
+  double begin = runreport::now();
+  long int lines=0;
+  bgdview datapoint;
+  while ( bgdf.next(datapoint) ) {
+    targets.insert( bgdline(datapoint)  );
+    ++lines;
   }
-  inf.close();
+  if ( !bgdf.good() ) {
+    cerr<<" ERROR : Cannot read file "<<dirfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  run_report.add_file(dirfile,bgdf.tell(),lines,runreport::now()-begin);
   
   // Test output file, then open it
   inf.open( outputfile.c_str() );
@@ -97,32 +122,40 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
   inf.close();
-  ouf.open( outputfile.c_str() );
-  ouf<<"# chrom, start, end, derivative"<<endl;
+  ouf.open( outputfile );
+  ouf<<"# chrom, start, end, derivative\n";
 
   
   
   // Parse the targets in pairs
+  run_report.phase("compute_and_write");
   double dx,dD,newpos;
   targit it1=targets.begin(),
     it2=++targets.begin();
   for ( ; it2!=targets.end(); ++it1,++it2 ) {
     
-    if (it1->chrom != it2->chrom) {
+    if (it1->chrom != it2->chrom && bedgraph) {
+      continue;
+    } else if (it1->chrom != it2->chrom) {
       cerr<<" ERROR : Not all directionality entries are on the same chromosome."<<endl;
-      cerr<<it1->chrom<<" "<<it2->chrom<<endl;
+      cerr<<it1->chrom_name()<<" "<<it2->chrom_name()<<endl;
+      ouf.close();
       exit(EXIT_FAILURE);
     }
    
     dx = it2->midpoint() - it1->midpoint();
     dD = it2->value - it1->value;
     newpos = it1->start + 0.5*dx;
-    ouf<<it1->chrom<<"\t"
+    ouf<<it1->chrom_name()<<"\t"
 	<<int(newpos)<<"\t"
 	<<int(newpos)+1<<"\t"
-	<<dD/dx<<endl;
+	<<dD/dx<<"\n";
   }
 
   ouf.close();
-  
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
+
 }
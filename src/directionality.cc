@@ -11,13 +11,15 @@
 #include<fstream>
 #include<sstream>
 #include<cmath>
+#include<vector>
 #include <tuple>
 
 #include "directionality.h"
 #include "bedfiles.h"
-
-#define HARD_MAX 10000000              // always ignore interactions further than this
-#define HARD_MIN 1000                  // always ignore interactions closer than this
+#include "metrics.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
 
 using namespace std;
 
@@ -26,12 +28,20 @@ int main(int argc, char *argv[]) {
   // get options from command line
   if (argc<7) {
     cout<<"Usage :"<<endl;
-    cout<<"       ./directionality -t targetsfile -f inputslist -o outputfile -min MIN -max MAX"<<endl;
+    cout<<"       ./directionality -t targetsfile -f inputslist -o outputfile -min MIN -max MAX [-j N] [--profile report]"<<endl;
+    cout<<"       ./directionality -t targetsfile -f inputslist -o outputfile -pairs PAIRS [-j N] [--profile report]"<<endl;
+    cout<<"       ./directionality -t targetsfile -f inputslist -o outputfile -grid MINS MAXS [-j N] [--profile report]"<<endl;
     cout<<"where       targetsfile  is a bed file with a list of targets."<<endl;
     cout<<"            inputslist   is a text file containing a list of paths to the normalized pile-up files along with the name of the target."<<endl;
     cout<<"            outfile      is a file name for the output."<<endl;
     cout<<"            MIN          is the minimum distance in bp from the target considered (Default 3000)."<<endl;
     cout<<"            MAX          is the maximum distance in bp from the target considered (Default 500,000)."<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to process targets (Default 1)."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<"            PAIRS        is a comma separated list of MIN:MAX pairs, e.g. 3000:500000,5000:1000000"<<endl;
+    cout<<"            MINS MAXS    are comma separated lists of MIN and MAX values; every combination is used."<<endl;
+    cout<<"With -pairs or -grid all pairs are found with one read of each file, and the output has"<<endl;
+    cout<<"one line per target and pair."<<endl;
     cout<<endl;
     cout<<"The inputslist file must have the following format:"<<endl;
     cout<<"         /path/to/captured_normalizedpileup_probe1.bdg        nameoftarget1"<<endl;
@@ -45,7 +55,13 @@ int main(int argc, char *argv[]) {
     outputfile;
 
   int min_dist=3000,
-    max_dist=500000;
+    max_dist=500000,
+    nthreads=1;
+
+  vector<dirwindow> windows;
+  bool sweep=false;
+
+  string profilefile;
 
   int argi=1;
   while (argi < argc) {
@@ -95,6 +111,63 @@ int main(int argc, char *argv[]) {
       max_dist = atoi(argv[argi+1]);
       argi += 2;
 
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-pairs" ) {
+      // list of MIN:MAX pairs
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-pairs)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      istringstream slist( argv[argi+1] );
+      string item;
+      while ( getline(slist,item,',') ) {
+	vector<int> minmax = parse_int_list(item,':');
+	if ( minmax.size()!=2 ) {
+	  cerr<<"Error parsing command line (-pairs "<<item<<")"<<endl;
+	  exit(EXIT_FAILURE);
+	}
+	windows.push_back( dirwindow(minmax[0],minmax[1]) );
+      }
+      sweep = true;
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-grid" ) {
+      // lists of MIN and MAX values
+      if (!(argi+2 < argc)) {
+        cerr<<"Error parsing command line (-grid)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      vector<int> mins = parse_int_list( argv[argi+1] ),
+	maxs = parse_int_list( argv[argi+2] );
+      if ( mins.empty() || maxs.empty() ) {
+        cerr<<"Error parsing command line (-grid)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      for (size_t i=0; i<mins.size(); ++i) {
+	for (size_t j=0; j<maxs.size(); ++j) {
+	  windows.push_back( dirwindow(mins[i],maxs[j]) );
+	}
+      }
+      sweep = true;
+      argi += 3;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
     } else {
       cerr<<"Error parsing command line (unrecognised option)"<<endl;
       exit(EXIT_FAILURE);
@@ -102,28 +175,45 @@ int main(int argc, char *argv[]) {
 
   }
 
+  if ( !profilefile.empty() && !run_report.open(profilefile,"directionality",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
   // Check optional parameters
-  if ( min_dist < HARD_MIN ) {
-      cerr<<"Error: MIN must be greater or equal to 1000"<<endl;
+  if ( !sweep ) {
+    windows.push_back( dirwindow(min_dist,max_dist) );
+  }
+  for (size_t w=0; w<windows.size(); ++w) {
+    if ( windows[w].min_dist < HARD_MIN ) {
+      cerr<<"Error: MIN must be greater or equal to "<<HARD_MIN<<endl;
+      exit(EXIT_FAILURE);
+    }
+    if ( windows[w].max_dist > HARD_MAX ) {
+      cerr<<"Error: MAX must be less than or equal to "<<HARD_MAX<<endl;
       exit(EXIT_FAILURE);
+    }
+    if ( windows[w].min_dist >= windows[w].max_dist ) {
+      cerr<<"Error: MIN must be less than MAX ("<<windows[w].min_dist<<":"<<windows[w].max_dist<<")"<<endl;
+      exit(EXIT_FAILURE);
+    }
   }
-  if ( max_dist > HARD_MAX ) {
-      cerr<<"Error: MAX must be less than or equal to 1000"<<endl;
+  if ( nthreads < 1 ) {
+      cerr<<"Error: N must be at least 1"<<endl;
       exit(EXIT_FAILURE);
   }
+  set_job_threads(nthreads);
 			   
 
 
   // Set up variables
   ifstream inf;
-  ofstream ouf;
   map<string,bedline> targets;
   map<string,string> inputfiles;
 
   string line;
-  double dir,
-    err;
 
+  run_report.phase("load_targets");
   // Read the targets file
   inf.open( targetsfile.c_str() );
   if ( !inf.good() ) {
@@ -136,6 +226,7 @@ int main(int argc, char *argv[]) {
   }
   inf.close();
 
+  run_report.phase("load_inputslist");
   // Read the inputs list
   inf.open( inputslist.c_str() );
   if ( !inf.good() ) {
@@ -162,15 +253,19 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
   inf.close();
-  ouf.open( outputfile.c_str() );
-  ouf<<"# chrom, start, end, targetname, directionality, error"<<endl;
 
   // Write messages
   cout<<"Finding directionalities for "<<inputfiles.size()<<" targets."<<endl;
-  cout<<"Reads between "<<min_dist<<" and "<<max_dist<<" from the target centre are considered."<<endl;
+  if ( sweep ) {
+    cout<<"Using "<<windows.size()<<" pairs of minimum and maximum distance from the target centre."<<endl;
+  } else {
+    cout<<"Reads between "<<min_dist<<" and "<<max_dist<<" from the target centre are considered."<<endl;
+  }
 
 
-  // Find directionalities
+  // Find the targets with a readable file, in target name order
+  vector<string> trgnames,
+    trgfiles;
   for (map<string,string>::iterator it=inputfiles.begin();it!=inputfiles.end(); ++it) {
     inf.open( (it->second).c_str() );
     bool testfile=inf.good();
@@ -178,84 +273,80 @@ int main(int argc, char *argv[]) {
     if ( !testfile ) {
       cerr<<" Warning : Cannot open file "<<it->second<<" skipping this."<<endl;
     } else {
-      tie(dir,err) = get_directoinality(it->second,targets[it->first],max_dist,min_dist);
-      ouf<<targets[it->first].chrom<<"\t"
-	 <<targets[it->first].start<<"\t"
-	 <<targets[it->first].end<<"\t"
-	 <<it->first<<"\t"
-	 <<dir<<"\t"
-	 <<err<<endl;
+      trgnames.push_back( it->first );
+      trgfiles.push_back( it->second );
     }
+  }
 
+  run_report.phase("compute");
+  // Find directionalities, largest files first when using threads
+  vector< vector< pair<double,double> > > results( trgnames.size() );
+  parallel_for( largest_first(trgfiles), nthreads, [&](const size_t &i) {
+      results[i] = get_directoinality(trgfiles[i],targets.find(trgnames[i])->second,windows);
+    } );
+
+  // a file can still fail as it is read (a corrupt compressed file)
+  size_t kept=0;
+  for (size_t i=0; i<trgnames.size(); ++i) {
+    if ( results[i].empty() ) {
+      cerr<<" Warning : Cannot read file "<<trgfiles[i]<<" skipping this."<<endl;
+    } else {
+      trgnames[kept] = trgnames[i];
+      results[kept++] = results[i];
+    }
   }
+  trgnames.resize(kept);
+  results.resize(kept);
 
-  ouf.close();
+  run_report.phase("write");
+  // Output in target name order
+  if ( !write_directionality(outputfile,targets,trgnames,windows,results,sweep) ) {
+    cerr<<" ERROR : Cannot write file "<<outputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
 
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
 
 }
 
 
 pair<double,double> get_directoinality(const string &file,const bedline &trg,const int &max_dist,const int &min_dist) {
-  // function to calculate the directionality
-  ifstream inf;
-  string line;
-  double dir,
-    upstream=0.0,
-    downstream=0.0,
-    total_reads=0.0;
-  int upwidth=0,
-    downwidth=0;
-  map<double,double> data;
-
-  double trgmid=0.5*(trg.start+trg.end);
-  double maxup=0,
-    minup=10e9,
-    maxdown=0,
-    mindown=10e9;
-
-  inf.open( file.c_str() );
-  while ( getline(inf,line) ) {
-    bgdline datapoint(line);
-
-    if ( trg.chrom == datapoint.chrom &&
-	 datapoint.end-trgmid>min_dist &&
-	 datapoint.start-trgmid<max_dist ) {
-	// downstream
-	downstream += datapoint.value;
-	if (datapoint.start<mindown) {mindown=datapoint.start;}
-	if (datapoint.end>maxdown) {maxdown=datapoint.end;}
-    }
-    if ( trg.chrom == datapoint.chrom &&
-	 datapoint.end-trgmid>-max_dist &&
-	 datapoint.start-trgmid<-min_dist ) {
-	// upstream
-	upstream += datapoint.value;
-	if (datapoint.start<minup) {minup=datapoint.start;}
-	if (datapoint.end>maxup) {maxup=datapoint.end;}
-    }
-    if ( trg.chrom == datapoint.chrom &&
-	 abs(datapoint.midpoint()-trgmid)<HARD_MAX &&
-	 abs(datapoint.midpoint()-trgmid)>HARD_MIN ) {
-      total_reads += datapoint.value;
-    }
-    
+  // function to calculate the directionality, NAN if the file cannot be read
+  vector< pair<double,double> > results = get_directoinality(file,trg,vector<dirwindow>(1,dirwindow(min_dist,max_dist)));
+  return results.empty() ? make_pair(double(NAN),double(NAN)) : results[0];
+}
+
+
+vector< pair<double,double> > get_directoinality(const string &file,const bedline &trg,const vector<dirwindow> &windows) {
+  // function to calculate the directionality for a set of windows, reading
+  // the file once, or not at all if there are saved cumulative sums
+  // (index_bdg -p), when each window takes a few binary searches. Empty if
+  // the file cannot be read.
+  dirmetric dir(trg,windows);
+  profilesums sums;
+  if ( sums.load(file) ) {
+    dir.add_sums(sums);
+  } else if ( !read_profile( file, trg, vector<profilemetric*>(1,&dir) ) ) {
+    return vector< pair<double,double> >();
   }
-  inf.close();
+  return dir.results();
+}
 
-  // now find the log_2 ratio of the up/down stream reads per bp
-  downwidth = maxdown-mindown;
-  upwidth = maxup-minup;
-  upstream /= double(upwidth);
-  downstream /= double(downwidth);
-  dir = log(upstream) - log(downstream);
-
-  // now find an error
-  double p1,p2,er1,er2,erLogRat;
-  p1=upstream/total_reads;
-  er1=p1*(1-p1)/sqrt(total_reads);
-  p2=downstream/total_reads;
-  er2=p2*(1-p2)/sqrt(total_reads);
-  erLogRat = sqrt( (er1/upstream)*(er1/upstream) + (er2/downstream)*(er2/downstream)  );
-  
-  return make_pair(dir,erLogRat);
+
+vector<int> parse_int_list(const string &list,const char &sep) {
+  // Convert a comma separated list into numbers, empty if there is an error
+  vector<int> values;
+  istringstream slist(list);
+  string item;
+  while ( getline(slist,item,sep) ) {
+    char *end;
+    long int v = strtol(item.c_str(),&end,10);
+    if ( item.empty() || *end!='\0' ) {
+      return vector<int>();
+    }
+    values.push_back(v);
+  }
+  return values;
 }
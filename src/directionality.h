@@ -9,12 +9,18 @@
 #define DIRECTIONALITY_H
 
 #include<string>
+#include<vector>
 
 #include "bedfiles.h"
+#include "metrics.h"
 
 using namespace std;
 
 pair<double,double>  get_directoinality(const string &,const bedline &,const int &,const int &);
 
+vector< pair<double,double> > get_directoinality(const string &,const bedline &,const vector<dirwindow> &);
+
+vector<int> parse_int_list(const string &,const char &sep=',');
+
 
 #endif
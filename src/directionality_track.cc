@@ -0,0 +1,288 @@
+//***************************************************************************
+//
+// Program to find the directionality along a chromosome from CaptureC
+// data, with every bin of a profile taken as the viewpoint in turn
+//
+//***************************************************************************
+
+#include<iostream>
+#include<cstdlib>
+#include<string>
+#include<map>
+#include<fstream>
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+#include "bedfiles.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
+
+using namespace std;
+
+struct trackbin {
+  // a bin of the profile, and the directionality with it as the viewpoint
+  long int start,
+    end;
+  double value,
+    dir;
+  bool operator<(const trackbin &b) const { return start<b.start; }
+};
+
+bool find_track(vector<trackbin>&,const int&,const int&);
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<5) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./directionality_track -i profile -o outputfile [-min MIN] [-max MAX] [-j N] [--profile report]"<<endl;
+    cout<<"where       profile      is a normalized pile-up file (bedGraph, binary, bigWig or gzip)."<<endl;
+    cout<<"            outfile      is a file name for the output bedGraph."<<endl;
+    cout<<"            MIN          is the minimum distance in bp from the bin considered (Default 3000)."<<endl;
+    cout<<"            MAX          is the maximum distance in bp from the bin considered (Default 500,000)."<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to process chromosomes (Default 1)."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<endl;
+    cout<<"Each bin is used as a viewpoint, with the windows of the directionality program, and its"<<endl;
+    cout<<"directionality is written as the value of that bin. Bins with no reads on one side are left"<<endl;
+    cout<<"out. The output can be given to direct_derivative with its -bdg option."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string inputfile,
+    outputfile;
+
+  int min_dist=3000,
+    max_dist=500000,
+    nthreads=1;
+
+  string profilefile;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-i" ) {
+      // profile
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-i)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      inputfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-o" ) {
+      // output file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-o)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      outputfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-min" ) {
+      // minimum distance
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-min)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      min_dist = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-max" ) {
+      // maximum distance
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-max)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      max_dist = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  if ( !profilefile.empty() && !run_report.open(profilefile,"directionality_track",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Check optional parameters
+  if ( min_dist < HARD_MIN ) {
+    cerr<<"Error: MIN must be greater or equal to "<<HARD_MIN<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( max_dist > HARD_MAX ) {
+    cerr<<"Error: MAX must be less than or equal to "<<HARD_MAX<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( min_dist >= max_dist ) {
+    cerr<<"Error: MIN must be less than MAX ("<<min_dist<<":"<<max_dist<<")"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( nthreads < 1 ) {
+      cerr<<"Error: N must be at least 1"<<endl;
+      exit(EXIT_FAILURE);
+  }
+  set_job_threads(nthreads);
+
+  // Test output file
+  ifstream inf( outputfile.c_str() );
+  if ( inf.good() ) {
+    cerr<<" ERROR : File "<<outputfile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+  inf.close();
+
+  // Read the profile, a list of bins for each chromosome in the order they
+  // are first seen
+  run_report.phase("load_profile");
+  bgdreader bgdf( inputfile );
+  if ( !bgdf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<inputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  double begin = runreport::now();
+  long int lines=0;
+  map<uint32_t,size_t> chromindex;
+  vector<uint32_t> chroms;
+  vector< vector<trackbin> > bins;
+  bgdview datapoint;
+  while ( bgdf.next(datapoint) ) {
+    map<uint32_t,size_t>::iterator c = chromindex.find(datapoint.chromid);
+    if ( c==chromindex.end() ) {
+      c = chromindex.insert( make_pair(datapoint.chromid,chroms.size()) ).first;
+      chroms.push_back(datapoint.chromid);
+      bins.push_back( vector<trackbin>() );
+    }
+    trackbin b;
+    b.start = datapoint.start;
+    b.end = datapoint.end;
+    b.value = datapoint.value;
+    b.dir = NAN;
+    bins[c->second].push_back(b);
+    ++lines;
+  }
+  if ( !bgdf.good() ) {
+    cerr<<" ERROR : Cannot read file "<<inputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  run_report.add_file(inputfile, bgdf.is_binary() ? lines*long(2*sizeof(int64_t)+sizeof(double)) : long(bgdf.tell()),
+		      lines, runreport::now()-begin);
+
+  cout<<"Finding the directionality of "<<lines<<" bins on "<<chroms.size()<<" chromosomes."<<endl;
+  cout<<"Reads between "<<min_dist<<" and "<<max_dist<<" from each bin centre are considered."<<endl;
+
+  // Chromosomes are independent, so can be done at the same time
+  run_report.phase("compute");
+  vector<size_t> order( chroms.size() );
+  for (size_t c=0; c<chroms.size(); ++c) {
+    order[c] = c;
+  }
+  vector<char> trackok( chroms.size(), 1 );
+  parallel_for( order, nthreads, [&](const size_t &c) {
+      trackok[c] = find_track(bins[c],min_dist,max_dist);
+    } );
+  for (size_t c=0; c<chroms.size(); ++c) {
+    if ( !trackok[c] ) {
+      cerr<<" ERROR : Bins overlap on "<<chrom_ids.name(chroms[c])<<" in file "<<inputfile<<endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  run_report.phase("write");
+  bgdwriter ouf( outputfile );
+  ouf<<"# chrom, start, end, directionality\n";
+  for (size_t c=0; c<chroms.size(); ++c) {
+    const string &name = chrom_ids.name(chroms[c]);
+    for (size_t i=0; i<bins[c].size(); ++i) {
+      if ( isfinite(bins[c][i].dir) ) {
+	ouf<<name<<"\t"
+	   <<bins[c][i].start<<"\t"
+	   <<bins[c][i].end<<"\t"
+	   <<bins[c][i].dir<<"\n";
+      }
+    }
+  }
+  ouf.close();
+  if ( !ouf.good() ) {
+    cerr<<" ERROR : Cannot write file "<<outputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
+
+}
+
+
+bool find_track(vector<trackbin> &bins,const int &min_dist,const int &max_dist) {
+  // Directionality of each bin, as dirmetric would find it with a target
+  // covering that bin. The bins must not overlap, so once sorted by start
+  // their ends are sorted too, and the bins in each window form a run
+  // [lo,hi) whose ends only move forward as the viewpoint does. The sum of
+  // values in a run comes from prefix sums, so the whole chromosome takes
+  // O(n) rather than O(n x window). Returns false if bins overlap.
+  stable_sort(bins.begin(),bins.end());
+  size_t n = bins.size();
+  for (size_t j=1; j<n; ++j) {
+    if ( bins[j].start<bins[j-1].end ) {
+      return false;
+    }
+  }
+  vector<double> prefix(n+1,0.0);
+  for (size_t j=0; j<n; ++j) {
+    prefix[j+1] = prefix[j]+bins[j].value;
+  }
+
+  size_t uplo=0,
+    uphi=0,
+    downlo=0,
+    downhi=0;
+  for (size_t i=0; i<n; ++i) {
+    double trgmid = 0.5*(bins[i].start+bins[i].end);
+
+    // upstream: end-trgmid > -max and start-trgmid < -min
+    while ( uplo<n && !(bins[uplo].end-trgmid>-max_dist) ) {++uplo;}
+    while ( uphi<n && bins[uphi].start-trgmid<-min_dist ) {++uphi;}
+
+    // downstream: end-trgmid > min and start-trgmid < max
+    while ( downlo<n && !(bins[downlo].end-trgmid>min_dist) ) {++downlo;}
+    while ( downhi<n && bins[downhi].start-trgmid<max_dist ) {++downhi;}
+
+    if ( uphi<=uplo || downhi<=downlo ) {
+      continue;
+    }
+    // reads per bp, over the span of the bins in the window
+    int upwidth = bins[uphi-1].end-bins[uplo].start,
+      downwidth = bins[downhi-1].end-bins[downlo].start;
+    double upstream = (prefix[uphi]-prefix[uplo])/double(upwidth),
+      downstream = (prefix[downhi]-prefix[downlo])/double(downwidth);
+    bins[i].dir = log(upstream) - log(downstream);
+  }
+  return true;
+}
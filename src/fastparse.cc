@@ -0,0 +1,281 @@
+//***************************************************************************
+//
+// Fast splitting of bedGraph lines into fields, and exact number parsers
+//
+//***************************************************************************
+
+#include<cstdlib>
+#include<cstring>
+#include<stdint.h>
+
+#include "fastparse.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+using namespace std;
+
+
+typedef void (*maskfn)(const char*,uint64_t&,uint64_t&);
+
+static void masks_scalar(const char *p,uint64_t &sep,uint64_t &nl) {
+  // bit i of sep is set if p[i] is a space or tab, of nl if it is a newline
+  sep = nl = 0;
+  for (int i=0; i<SCAN_CHUNK; ++i) {
+    sep |= uint64_t(p[i]==' ' || p[i]=='\t')<<i;
+    nl |= uint64_t(p[i]=='\n')<<i;
+  }
+}
+
+#ifdef SCAN_X86
+static void masks_sse2(const char *p,uint64_t &sep,uint64_t &nl) {
+  // SSE2 is always there on x86-64
+  const __m128i space = _mm_set1_epi8(' '),
+    tab = _mm_set1_epi8('\t'),
+    newline = _mm_set1_epi8('\n');
+  sep = nl = 0;
+  for (int k=0; k<4; ++k) {
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p+16*k) );
+    __m128i s = _mm_or_si128( _mm_cmpeq_epi8(v,space), _mm_cmpeq_epi8(v,tab) );
+    sep |= uint64_t( uint16_t(_mm_movemask_epi8(s)) )<<(16*k);
+    nl |= uint64_t( uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v,newline))) )<<(16*k);
+  }
+}
+
+__attribute__((target("avx2")))
+static void masks_avx2(const char *p,uint64_t &sep,uint64_t &nl) {
+  const __m256i space = _mm256_set1_epi8(' '),
+    tab = _mm256_set1_epi8('\t'),
+    newline = _mm256_set1_epi8('\n');
+  sep = nl = 0;
+  for (int k=0; k<2; ++k) {
+    __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(p+32*k) );
+    __m256i s = _mm256_or_si256( _mm256_cmpeq_epi8(v,space), _mm256_cmpeq_epi8(v,tab) );
+    sep |= uint64_t( uint32_t(_mm256_movemask_epi8(s)) )<<(32*k);
+    nl |= uint64_t( uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,newline))) )<<(32*k);
+  }
+}
+
+__attribute__((target("avx512bw")))
+static void masks_avx512(const char *p,uint64_t &sep,uint64_t &nl) {
+  __m512i v = _mm512_loadu_si512( reinterpret_cast<const void*>(p) );
+  sep = _mm512_cmpeq_epi8_mask(v,_mm512_set1_epi8(' ')) | _mm512_cmpeq_epi8_mask(v,_mm512_set1_epi8('\t'));
+  nl = _mm512_cmpeq_epi8_mask(v,_mm512_set1_epi8('\n'));
+}
+#endif
+
+static maskfn pick_masks(const char **name) {
+  // the widest version the CPU has, chosen once at start up
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512bw") ) {
+    *name = "avx512bw";
+    return masks_avx512;
+  }
+  if ( __builtin_cpu_supports("avx2") ) {
+    *name = "avx2";
+    return masks_avx2;
+  }
+  *name = "sse2";
+  return masks_sse2;
+#else
+  *name = "scalar";
+  return masks_scalar;
+#endif
+}
+
+static const char *simd_name = "scalar";
+static maskfn chunk_masks = pick_masks(&simd_name);
+
+const char* scan_simd_name() {
+  return simd_name;
+}
+
+
+void scan_masks(const char *p,uint64_t &sep,uint64_t &nl) {
+  chunk_masks(p,sep,nl);
+}
+
+
+void scan_masks_scalar(const char *p,uint64_t &sep,uint64_t &nl) {
+  masks_scalar(p,sep,nl);
+}
+
+
+static inline bool scan_with(const maskfn masks,const char *p,const char *bufend,const int &maxfields,linefields &f) {
+  // Find the first maxfields fields of the line at p, and its newline,
+  // SCAN_CHUNK bytes at a time. The changes between field and separator
+  // characters are found from the masks, so each field costs a couple of
+  // bit operations. Returns false if the newline is not found before the
+  // last whole chunk in the buffer, which the caller must then handle.
+  int limit = maxfields<SCAN_MAXFIELDS ? maxfields : SCAN_MAXFIELDS;
+  uint64_t carry=0;   // the byte before the chunk is in a field
+  f.n = 0;
+  bool open=false;
+  for (const char *chunk=p; chunk+SCAN_CHUNK<=bufend; chunk+=SCAN_CHUNK) {
+    uint64_t sep,
+      nl;
+    masks(chunk,sep,nl);
+    uint64_t in = ~(sep|nl),
+      valid = ~uint64_t(0);
+    int lim = nl ? __builtin_ctzll(nl) : SCAN_CHUNK;
+    if ( lim<SCAN_CHUNK ) {
+      // nothing after the newline counts, but it can end a field
+      in &= (uint64_t(1)<<lim)-1;
+      valid = lim==SCAN_CHUNK-1 ? ~uint64_t(0) : (uint64_t(2)<<lim)-1;
+    }
+    uint64_t t = (in ^ ((in<<1)|carry)) & valid;
+    while ( t && f.n<limit ) {
+      int i = __builtin_ctzll(t);
+      if ( (in>>i)&1 ) {
+	f.start[f.n] = chunk+i;
+	open = true;
+      } else if ( open ) {
+	f.end[f.n++] = chunk+i;
+	open = false;
+      }
+      t &= t-1;
+    }
+    if ( lim<SCAN_CHUNK ) {
+      f.eol = chunk+lim;
+      return true;
+    }
+    carry = in>>(SCAN_CHUNK-1);
+  }
+  return false;
+}
+
+
+bool scan_line(const char *p,const char *bufend,const int &maxfields,linefields &f) {
+  return scan_with(chunk_masks,p,bufend,maxfields,f);
+}
+
+
+bool scan_line_scalar(const char *p,const char *bufend,const int &maxfields,linefields &f) {
+  // As scan_line(), with the portable masks whatever the CPU
+  return scan_with(masks_scalar,p,bufend,maxfields,f);
+}
+
+
+long int parse_long(const char *p,const char **q) {
+  // As strtol(p,q,10) for p not at white space, which it is used for when
+  // there are too many digits to be sure of no overflow
+  const char *s = p;
+  bool neg=false;
+  if ( *s=='-' || *s=='+' ) {
+    neg = *s=='-';
+    ++s;
+  }
+  const char *digits = s;
+  uint64_t v=0;
+  while ( *s>='0' && *s<='9' ) {
+    v = 10*v+(*s-'0');
+    ++s;
+  }
+  if ( s==digits ) {
+    *q = p;
+    return 0;
+  }
+  if ( s-digits>18 ) {
+    char *e;
+    long int r = strtol(p,&e,10);
+    *q = e;
+    return r;
+  }
+  *q = s;
+  return neg ? -long(v) : long(v);
+}
+
+
+static const double exact_pow10[23] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,
+				       1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+double parse_double(const char *p,const char **q) {
+  // As strtod(p,q) for p not at white space. When the digits make an
+  // integer w below 2^53 and the decimal exponent e is at most 22 either
+  // way, w and 10^e are exact doubles, so one multiplication or division
+  // gives the correctly rounded result, as strtod does (Clinger's fast
+  // path). Everything else (more digits, larger exponents, hex, inf, nan)
+  // is given to strtod.
+  const char *s = p;
+  bool neg=false;
+  if ( *s=='-' || *s=='+' ) {
+    neg = *s=='-';
+    ++s;
+  }
+  if ( s[0]=='0' && (s[1]=='x' || s[1]=='X') ) {
+    char *e;
+    double r = strtod(p,&e);
+    *q = e;
+    return r;
+  }
+  uint64_t w=0;
+  int ndigits=0,      // digits from the first which is not zero
+    nfrac=0;
+  bool any=false;
+  while ( *s>='0' && *s<='9' ) {
+    w = 10*w+(*s-'0');
+    ndigits += (w!=0);
+    any = true;
+    ++s;
+  }
+  if ( *s=='.' ) {
+    ++s;
+    while ( *s>='0' && *s<='9' ) {
+      w = 10*w+(*s-'0');
+      ndigits += (w!=0);
+      ++nfrac;
+      any = true;
+      ++s;
+    }
+  }
+  if ( !any || ndigits>19 ) {
+    char *e;
+    double r = strtod(p,&e);
+    *q = e;
+    return r;
+  }
+  long int exponent=0;
+  if ( *s=='e' || *s=='E' ) {
+    const char *t = s+1;
+    bool eneg=false;
+    if ( *t=='-' || *t=='+' ) {
+      eneg = *t=='-';
+      ++t;
+    }
+    if ( *t>='0' && *t<='9' ) {
+      while ( *t>='0' && *t<='9' && exponent<100000 ) {
+	exponent = 10*exponent+(*t-'0');
+	++t;
+      }
+      if ( *t>='0' && *t<='9' ) {
+	char *e;
+	double r = strtod(p,&e);
+	*q = e;
+	return r;
+      }
+      exponent = eneg ? -exponent : exponent;
+      s = t;
+    }
+  }
+  exponent -= nfrac;
+  if ( w>(uint64_t(1)<<53) || exponent<-22 || exponent>22 ) {
+    if ( w!=0 ) {
+      char *e;
+      double r = strtod(p,&e);
+      *q = e;
+      return r;
+    }
+    exponent = 0;
+  }
+  *q = s;
+  double r = double(w);
+  if ( exponent<0 ) {
+    r /= exact_pow10[-exponent];
+  } else {
+    r *= exact_pow10[exponent];
+  }
+  return neg ? -r : r;
+}
@@ -0,0 +1,40 @@
+//***************************************************************************
+//
+// Header for
+// Fast splitting of bedGraph lines into fields, and exact number parsers
+//
+//***************************************************************************
+
+#ifndef FASTPARSE_H
+#define FASTPARSE_H
+
+#include<cstddef>
+#include<stdint.h>
+
+using namespace std;
+
+#define SCAN_CHUNK 64        // bytes looked at in one step by scan_line()
+#define SCAN_MAXFIELDS 8
+
+struct linefields {
+  // the fields of a line (runs of characters other than space and tab) and
+  // the newline which ends it
+  const char *start[SCAN_MAXFIELDS],
+    *end[SCAN_MAXFIELDS];
+  int n;
+  const char *eol;
+};
+
+bool scan_line(const char*,const char*,const int&,linefields&);
+const char* scan_simd_name();
+
+// the same with the portable version, and the masks of one chunk from each,
+// so that the SIMD versions can be checked against it
+bool scan_line_scalar(const char*,const char*,const int&,linefields&);
+void scan_masks(const char*,uint64_t&,uint64_t&);
+void scan_masks_scalar(const char*,uint64_t&,uint64_t&);
+
+long int parse_long(const char*,const char**);
+double parse_double(const char*,const char**);
+
+#endif
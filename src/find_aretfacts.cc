@@ -13,11 +13,18 @@
 #include<fstream>
 #include<sstream>
 #include<cmath>
+#include<climits>
+#include<cstdio>
+#include<algorithm>
 #include <sys/stat.h>
+#include <dirent.h>
 
 
 #include "find_aretfacts.h"
 #include "bedfiles.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
 
 using namespace std;
 
@@ -34,11 +41,18 @@ int main(int argc, char *argv[]) {
   // get options from command line
   if (argc<9) {
     cout<<"Usage :"<<endl;
-    cout<<"       ./find_aretfacts -f indir1 outdir1 -f indir2 outdir2 [-f indir3 outdir3...] -t target -a factor"<<endl;
+    cout<<"       ./find_aretfacts -f indir1 outdir1 -f indir2 outdir2 [-f indir3 outdir3...] -t target -a factor [-z] [--profile report]"<<endl;
+    cout<<"       ./find_aretfacts -f indir1 outdir1 -f indir2 outdir2 [-f indir3 outdir3...] -all -a factor [-j N] [-z] [--profile report]"<<endl;
     cout<<"where       indir1       is a directory with rep1 input files captured_rawpileup_ and captured_normalizedpileup_ files"<<endl;
     cout<<"            outdir1      is a directory for output of rep1."<<endl;
     cout<<"            target       is the name of a target."<<endl;
     cout<<"            a            is the factor for how much bigger than the other replicates the signal has to be to be condiered an aretfact."<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to process targets (Default 1)."<<endl;
+    cout<<"            -z           OPTIONAL: write the output pile-ups compressed, as BGZF (.bdg.gz)."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<"With -all every target with captured_normalizedpileup_ and captured_rawpileup_ files in all"<<endl;
+    cout<<"the indirs is processed, and the number of artefacts found for each is listed. Input pile-ups"<<endl;
+    cout<<"may be .bdg or gzip/BGZF compressed .bdg.gz files."<<endl;
     cout<<endl;
     cout<<"The indirs and outdirs must come in pairs, and there must be at least two pairs."<<endl;
     exit(EXIT_FAILURE);
@@ -48,6 +62,10 @@ int main(int argc, char *argv[]) {
   map<string, string> outdir;
   string target;
   double factor=10.0;
+  bool alltargets=false,
+    compress=false;
+  int nthreads=1;
+  string profilefile;
 
   int argi=1;
   while (argi < argc) {
@@ -71,6 +89,25 @@ int main(int argc, char *argv[]) {
       target = string(argv[argi+1]);
       argi += 2;
 
+    } else if ( string(argv[argi]) == "-all" ) {
+      // all targets found in the input dirs
+      alltargets = true;
+      argi += 1;
+
+    } else if ( string(argv[argi]) == "-z" ) {
+      // compressed output
+      compress = true;
+      argi += 1;
+
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
     } else if ( string(argv[argi]) == "-a" ) {
       // input file list
       if (!(argi+1 < argc)) {
@@ -80,6 +117,15 @@ int main(int argc, char *argv[]) {
       factor = atof(argv[argi+1]);
       argi += 2;
 
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
     } else {
       cerr<<"Error parsing command line (unrecognised option)"<<endl;
       exit(EXIT_FAILURE);
@@ -87,6 +133,13 @@ int main(int argc, char *argv[]) {
 
   }
 
+  if ( !profilefile.empty() && !run_report.open(profilefile,"find_aretfacts",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  set_job_threads(nthreads);
+
   // test variables
   if ( indir.size()<2 ) {
       cerr<<"Not enough input dirs"<<endl;
@@ -100,17 +153,40 @@ int main(int argc, char *argv[]) {
       cerr<<"Must have same number of input and output dirs."<<endl;
       exit(EXIT_FAILURE);
   }
-  if ( target=="" ) {
+  if ( target=="" && !alltargets ) {
       cerr<<"Invalid target."<<endl;
       exit(EXIT_FAILURE);
   }
+  if ( target!="" && alltargets ) {
+      cerr<<"Use either -t or -all, not both."<<endl;
+      exit(EXIT_FAILURE);
+  }
   if ( factor<=0 ) {
       cerr<<"Invalid value for factor."<<endl;
       exit(EXIT_FAILURE);
   }
 
+  vector<string> reps( indir.begin(), indir.end() ),
+    targets;
+
+  // find the targets
+  run_report.phase("load_targets");
+  if ( alltargets ) {
+    targets = find_targets(reps);
+    if ( targets.size()==0 ) {
+      cerr<<"No targets found with pile-up files in all input dirs"<<endl;
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    targets.push_back(target);
+  }
+
   // write a message
-  cout<<"Looking for artefacts in target "<<target<<" in directories"<<endl;
+  if ( alltargets ) {
+    cout<<"Looking for artefacts in "<<targets.size()<<" targets in directories"<<endl;
+  } else {
+    cout<<"Looking for artefacts in target "<<target<<" in directories"<<endl;
+  }
   for (set<string>::const_iterator it=indir.begin(); it!=indir.end(); ++it) {
     cout<<"   "<<*it<<"    --->   "<<outdir[*it]<<endl;
   }
@@ -118,115 +194,392 @@ int main(int argc, char *argv[]) {
 
   // set up rest of variables
   ifstream inf;
-  ofstream ouf;
-  string line;
-
-  map<string, set<bgdline> > input_rep;
-  map<double,  datapoint> data;
-
-  int counter=0;
-
-  double sum,
-    meanoftherest;
 
   // test output dir exists and files do not
+  const string outext = compress ? ".bdg.gz" : ".bdg";
   for (set<string>::const_iterator it=indir.begin(); it!=indir.end(); ++it) {
     if ( !DirExist(outdir[*it]) ) {
       cerr<<"Cannot find directory "<<outdir[*it]<<endl;
       exit(EXIT_FAILURE);
     }
-    inf.open( (outdir[*it]+"/captured_rawpileup_"+target+".bdg").c_str() );
-    if ( inf.good() ) {
-      cerr<<"File "<<outdir[*it]+"/captured_rawpileup_"+target+".bdg"<<" already exists, will not overwrite."<<endl;
-      exit(EXIT_FAILURE);
+    for (size_t t=0; t<targets.size(); ++t) {
+      inf.open( (outdir[*it]+"/captured_rawpileup_"+targets[t]+outext).c_str() );
+      if ( inf.good() ) {
+	cerr<<"File "<<outdir[*it]+"/captured_rawpileup_"+targets[t]+outext<<" already exists, will not overwrite."<<endl;
+	exit(EXIT_FAILURE);
+      }
+      inf.close();
     }
-    inf.close();
   }
 
-  // load inputs into memory
-  for (set<string>::const_iterator it=indir.begin(); it!=indir.end(); ++it) {
-    //cout<<"Loading "<<*it+"/captured_normalizedpileup_"+target+".bdg"<<endl;
-    inf.open( (*it+"/captured_normalizedpileup_"+target+".bdg").c_str() );
-    if ( !inf.good() ) {
-      cerr<<"Cannot open file "<<*it+"/captured_normalizedpileup_"+target+".bdg"<<endl;
-      exit(EXIT_FAILURE);
-    }
-    input_rep[*it]=set<bgdline>();
-    while ( getline(inf,line) ) {
-      input_rep[*it].insert( bgdline(line) );
+  // process the targets, largest files first when using threads
+  run_report.phase("compute");
+  vector<string> firstfiles;
+  for (size_t t=0; t<targets.size(); ++t) {
+    firstfiles.push_back( pileup_file(reps[0],"captured_normalizedpileup_",targets[t]) );
+  }
+  vector<long int> counts( targets.size() );
+  vector<string> errors( targets.size() );
+  parallel_for( largest_first(firstfiles), nthreads, [&](const size_t &t) {
+      counts[t] = clean_target(reps,outdir,targets[t],factor,compress,errors[t]);
+    } );
+
+  // report in target name order
+  run_report.phase("write");
+  long int total=0;
+  bool failed=false;
+  for (size_t t=0; t<targets.size(); ++t) {
+    if ( counts[t]<0 ) {
+      cerr<<errors[t]<<endl;
+      failed = true;
+    } else {
+      total += counts[t];
     }
-    inf.close();
+  }
+  if ( failed ) {
+    exit(EXIT_FAILURE);
   }
 
-  // convert the data into a list
-  for (set<string>::const_iterator REPit=indir.begin(); REPit!=indir.end(); ++REPit) {
-    for (set<bgdline>::iterator LINEit=input_rep[*REPit].begin(); LINEit!=input_rep[*REPit].end(); ++LINEit) {
-      double mid=0.5*double(LINEit->start+LINEit->end);
-      data[ mid ].chrom=LINEit->chrom;
-      data[ mid ].start=LINEit->start;
-      data[ mid ].end=LINEit->end;
-      data[ mid ].value[*REPit]=LINEit->value;
+  if ( alltargets ) {
+    cout<<"# target, artefacts"<<endl;
+    for (size_t t=0; t<targets.size(); ++t) {
+      cout<<targets[t]<<"\t"<<counts[t]<<endl;
     }
   }
+  cout<<"Found "<<total<<" artefacts"<<endl;
 
-  // save memory by clearing the sets
-  input_rep.clear();
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
 
-  // find artefacts
-  for (map<double,  datapoint>::iterator it=data.begin(); it!=data.end(); ++it) {
-    // fill zeros and get sum
-    sum = 0.0;
-    for (set<string>::const_iterator REPit=indir.begin(); REPit!=indir.end(); ++REPit) {
-      if ( it->second.value.count( *REPit )==0 ) {
-	it->second.value[*REPit] = 0;
-      }
-      sum += it->second.value[*REPit];
+}
+
+
+vector<string> find_targets(const vector<string> &reps) {
+  // Get the names of targets which have both a normalized and a raw pile-up
+  // (compressed or not) in every input directory, in name order
+  const string norm="captured_normalizedpileup_",
+    raw="captured_rawpileup_",
+    ext=".bdg",
+    gzext=".bdg.gz";
+  vector<string> targets;
+  set<string> names;
+
+  DIR *dir = opendir( reps[0].c_str() );
+  if ( dir==NULL ) {
+    return targets;
+  }
+  struct dirent *entry;
+  while ( (entry=readdir(dir))!=NULL ) {
+    string name(entry->d_name);
+    if ( name.size()>norm.size()+ext.size() && name.compare(0,norm.size(),norm)==0
+	 && name.compare(name.size()-ext.size(),ext.size(),ext)==0 ) {
+      names.insert( name.substr(norm.size(),name.size()-norm.size()-ext.size()) );
+    } else if ( name.size()>norm.size()+gzext.size() && name.compare(0,norm.size(),norm)==0
+		&& name.compare(name.size()-gzext.size(),gzext.size(),gzext)==0 ) {
+      names.insert( name.substr(norm.size(),name.size()-norm.size()-gzext.size()) );
     }
-    // test for aretefacts
-    for (set<string>::const_iterator REPit=indir.begin(); REPit!=indir.end(); ++REPit) {
-      meanoftherest = (sum-it->second.value[*REPit])/indir.size();
-      if ( it->second.value[*REPit] > factor*meanoftherest ) {
-	// it is an artefact
-	it->second.artef[*REPit] = true;
-	//cout<<it->second.value[*REPit] <<" "<< factor*meanoftherest <<endl;
-	counter++;
-      } else {
-	// it is not
-	it->second.artef[*REPit] = false;
-      }
+  }
+  closedir(dir);
+
+  struct stat buffer;
+  for (set<string>::const_iterator it=names.begin(); it!=names.end(); ++it) {
+    bool found=true;
+    for (size_t r=0; r<reps.size() && found; ++r) {
+      found = stat( pileup_file(reps[r],norm,*it).c_str(), &buffer )==0
+	&& stat( pileup_file(reps[r],raw,*it).c_str(), &buffer )==0;
+    }
+    if ( found ) {
+      targets.push_back( *it );
+    } else {
+      cerr<<" Warning : Pile-up files for target "<<*it<<" are not in all input dirs, skipping this."<<endl;
     }
   }
- 
-  cout<<"Found "<<counter<<" artefacts"<<endl;
+
+  return targets;
+}
+
+
+string pileup_file(const string &dir,const string &kind,const string &target) {
+  // The pile-up of a kind for a target in dir, dir/kind+target.bdg or if
+  // there is not one the compressed dir/kind+target.bdg.gz
+  string file = dir+"/"+kind+target+".bdg";
+  struct stat buffer;
+  if ( stat(file.c_str(),&buffer)!=0 && stat((file+".gz").c_str(),&buffer)==0 ) {
+    file += ".gz";
+  }
+  return file;
+}
+
+
+long int clean_target(const vector<string> &reps,const map<string,string> &outdir,const string &target,const double &factor,
+		      const bool &compress,string &error) {
+  // Find the artefacts for one target, and write the rawpileups with them
+  // removed, as BGZF if compress is set. Returns the number of artefacts, or
+  // -1 on error.
+  vector<string> normfiles;
+  vector<artefactlist> artefacts;
+
+  // find artefacts with a merge of the (sorted) normalized pile ups
+  for (size_t r=0; r<reps.size(); ++r) {
+    normfiles.push_back( pileup_file(reps[r],"captured_normalizedpileup_",target) );
+  }
+  long int counter = find_artefacts(normfiles,factor,artefacts,error);
+  if ( counter<0 ) {
+    return -1;
+  }
 
   // copy input rawpileups into output rawpileups  
-  for (set<string>::const_iterator it=indir.begin(); it!=indir.end(); ++it) {
-    inf.open( (*it+"/captured_rawpileup_"+target+".bdg").c_str() );
-    if ( !inf.good() ) {
-      cerr<<"Cannot open file "<<*it+"/captured_rawpileup_"+target+".bdg"<<endl;
-      exit(EXIT_FAILURE);
+  for (size_t r=0; r<reps.size(); ++r) {
+    string infile = pileup_file(reps[r],"captured_rawpileup_",target),
+      outfile = outdir.find(reps[r])->second+"/captured_rawpileup_"+target+(compress ? ".bdg.gz" : ".bdg");
+    bgdreader bgdf( infile );
+    if ( !bgdf.good() ) {
+      error = "Cannot open file "+infile;
+      return -1;
+    }
+    bgdwriter ouf( outfile, true, compress );
+    if ( !ouf.good() ) {
+      error = "Cannot write to file "+outfile;
+      return -1;
     }
-    ouf.open( (outdir[*it]+"/captured_rawpileup_"+target+".bdg").c_str() );
 
-    
-    while ( getline(inf,line) ) {
-      bgdline mybgdline = bgdline(line);
-      if ( data[ mybgdline.midpoint() ].artef[*it] ) {
+    double begin = run_report.enabled() ? runreport::now() : 0.0;
+    long int lines=0;
+    strview rawline;
+    bgdview mybgdline;
+    while ( bgdf.getline(rawline) ) {
+      ++lines;
+      if ( bgdf.parse(rawline,mybgdline) && is_artefact(artefacts[r],mybgdline) ) {
 	// it is an artefact
-	ouf<<data[ mybgdline.midpoint() ].chrom<<"\t"
-	   <<data[ mybgdline.midpoint() ].start<<"\t"
-	   <<data[ mybgdline.midpoint() ].end<<"\t"
-	   <<"0"<<endl;
+	ouf<<mybgdline.chrom<<"\t"
+	   <<mybgdline.start<<"\t"
+	   <<mybgdline.end<<"\t"
+	   <<"0\n";
       } else {
 	// it is not an artefact
-	ouf<<line<<endl;
+	ouf<<rawline<<'\n';
       }
 
     }
+    // binary and bigWig profiles have no lines to copy, so their records
+    // are written out as bedGraph
+    while ( bgdf.is_binary() && bgdf.next(mybgdline) ) {
+      ++lines;
+      ouf<<mybgdline.chrom<<"\t"
+	 <<mybgdline.start<<"\t"
+	 <<mybgdline.end<<"\t";
+      if ( is_artefact(artefacts[r],mybgdline) ) {
+	ouf<<"0\n";
+      } else {
+	write_value(ouf,mybgdline.value);
+	ouf<<"\n";
+      }
+    }
 
     ouf.close();
-    inf.close();
+    if ( !bgdf.good() ) {
+      error = "Cannot read file "+infile;
+      return -1;
+    }
+    if ( !ouf.good() ) {
+      error = "Error writing file "+outfile;
+      return -1;
+    }
+    if ( run_report.enabled() ) {
+      struct stat buffer;
+      stat(infile.c_str(),&buffer);
+      run_report.add_file(infile,bgdf.is_binary() ? long(buffer.st_size) : long(bgdf.tell()),lines,runreport::now()-begin);
+    }
+  }
+
+  return counter;
+}
+
+
+long int find_artefacts(const vector<string> &files,const double &factor,vector<artefactlist> &artefacts,string &error) {
+  // Stream through the normalized pile ups of all replicates together, in
+  // one pass, one chromosome at a time and in order of fragment midpoint, so
+  // only the current line of each file is held. Files must be sorted by
+  // chromosome then start, with the chromosomes in the same order (a file
+  // may lack some of them), which is checked as they are read. Returns the
+  // number of artefacts, or -1 on error.
+  size_t nrep=files.size();
+  vector<bgdreader*> readers;
+  vector<repcursor> cur(nrep);
+  vector<double> value(nrep);
+  vector<long int> lines(nrep,0);
+  double begin = run_report.enabled() ? runreport::now() : 0.0;
+  set<uint32_t> done;
+  long int counter=0;
+  double sum,
+    meanoftherest,
+    mid;
+
+  artefacts.assign(nrep,artefactlist());
+
+  for (size_t r=0; r<nrep; ++r) {
+    readers.push_back( new bgdreader(files[r]) );
+    cur[r].bgdf = readers[r];
+    cur[r].more = false;
+    cur[r].listed = false;
+    if ( !readers[r]->good() ) {
+      error = "Cannot open file "+files[r];
+      counter = -1;
+    } else {
+      cur[r].more = readers[r]->next(cur[r].datapoint);
+      cur[r].mid = cur[r].datapoint.midpoint();
+      lines[r] += cur[r].more;
+    }
   }
 
+  while ( counter>=0 ) {
+    // the next chromosome is the one all replicates with lines left are at;
+    // if they differ, it is one of theirs which none of the others still
+    // has to come to (they lack it, or have passed it)
+    uint32_t chrom=NO_CHROM;
+    bool same=true;
+    for (size_t r=0; r<nrep; ++r) {
+      if ( cur[r].more ) {
+	same = same && (chrom==NO_CHROM || chrom==cur[r].datapoint.chromid);
+	chrom = chrom==NO_CHROM ? cur[r].datapoint.chromid : chrom;
+      }
+    }
+    if ( chrom==NO_CHROM ) {
+      break;
+    }
+    if ( !same ) {
+      for (size_t r=0; r<nrep; ++r) {
+	if ( cur[r].more && !cur[r].listed ) {
+	  list_chroms(files[r],cur[r]);
+	}
+      }
+      chrom = NO_CHROM;
+      for (size_t r=0; r<nrep && chrom==NO_CHROM; ++r) {
+	bool first = cur[r].more;
+	for (size_t o=0; o<nrep && first; ++o) {
+	  first = !cur[o].more || !cur[o].comes_later(cur[r].datapoint.chromid);
+	}
+	if ( first ) {
+	  chrom = cur[r].datapoint.chromid;
+	}
+      }
+      if ( chrom==NO_CHROM ) {
+	error = "The files do not have their chromosomes in the same order";
+	counter = -1;
+	break;
+      }
+    }
+    const string &name = chrom_ids.name(chrom);
+    if ( !done.insert(chrom).second ) {
+      error = "Chromosome "+name+" is not in one block, or the files do not have their chromosomes in the same order";
+      counter = -1;
+      break;
+    }
 
+    while ( counter>=0 ) {
+      // next position is the lowest midpoint of any replicate
+      bool any=false;
+      for (size_t r=0; r<nrep; ++r) {
+	if ( cur[r].more && cur[r].datapoint.chromid==chrom && (!any || cur[r].mid<mid) ) {
+	  mid = cur[r].mid;
+	  any = true;
+	}
+      }
+      if (!any) {
+	break;
+      }
+
+      // fill zeros and get sum, moving on the replicates at this position
+      sum = 0.0;
+      for (size_t r=0; r<nrep; ++r) {
+	value[r] = 0.0;
+	if ( cur[r].more && cur[r].datapoint.chromid==chrom && cur[r].mid==mid ) {
+	  value[r] = cur[r].datapoint.value;
+	  while ( cur[r].more && cur[r].datapoint.chromid==chrom && cur[r].mid==mid ) {
+	    cur[r].more = cur[r].bgdf->next(cur[r].datapoint);
+	    cur[r].mid = cur[r].datapoint.midpoint();
+	    lines[r] += cur[r].more;
+	  }
+	  if ( cur[r].more && cur[r].datapoint.chromid==chrom && cur[r].mid<mid ) {
+	    error = "File "+files[r]+" is not sorted on "+name;
+	    counter = -1;
+	  }
+	}
+	sum += value[r];
+      }
+
+      // test for aretefacts
+      for (size_t r=0; r<nrep; ++r) {
+	meanoftherest = (sum-value[r])/nrep;
+	if ( value[r] > factor*meanoftherest ) {
+	  // it is an artefact
+	  artefacts[r][name].push_back(mid);
+	  counter++;
+	}
+      }
+    }
+  }
+
+  for (size_t r=0; r<nrep && counter>=0; ++r) {
+    if ( !readers[r]->good() ) {
+      error = "Cannot read file "+files[r];
+      counter = -1;
+    }
+  }
+  for (size_t r=0; r<nrep; ++r) {
+    if ( run_report.enabled() && counter>=0 ) {
+      // the files are read together, so each is given the time for all
+      struct stat buffer;
+      stat(files[r].c_str(),&buffer);
+      run_report.add_file(files[r],buffer.st_size,lines[r],runreport::now()-begin);
+    }
+    delete readers[r];
+  }
+  return counter;
+}
+
+
+void list_chroms(const string &file,repcursor &cur) {
+  // The chromosomes of a file in the order they come, read with a second
+  // reader. Only needed when the replicates do not all have the same
+  // chromosomes.
+  bgdreader bgdf(file);
+  bgdview datapoint;
+  while ( bgdf.next(datapoint) ) {
+    if ( cur.chroms.empty() || cur.chroms.back()!=datapoint.chromid ) {
+      cur.chroms.push_back(datapoint.chromid);
+    }
+  }
+  cur.listed = true;
+}
+
+
+bool repcursor::comes_later(const uint32_t &chrom) const {
+  // chrom is in the file after the current chromosome
+  vector<uint32_t>::const_iterator c = find(chroms.begin(),chroms.end(),datapoint.chromid);
+  return c!=chroms.end() && find(c+1,chroms.end(),chrom)!=chroms.end();
+}
+
+
+void write_value(bgdwriter &ouf,const double &value) {
+  // A value from a binary or bigWig profile, in full so that none is lost
+  // (raw pile-ups are read counts, so usually whole numbers)
+  if ( value==floor(value) && fabs(value)<1e15 ) {
+    ouf<<(long int)value;
+  } else {
+    char text[32];
+    int n = snprintf(text,sizeof(text),"%.17g",value);
+    ouf.write(text,n);
+  }
+}
+
+
+bool is_artefact(const artefactlist &artefacts,const bgdview &datapoint) {
+  // Look up a line in the list of artefacts for its replicate
+  artefactlist::const_iterator c = artefacts.find( datapoint.chrom.str() );
+  if ( c==artefacts.end() ) {
+    return false;
+  }
+  return binary_search( c->second.begin(), c->second.end(), datapoint.midpoint() );
 }
@@ -10,19 +10,40 @@
 
 #include<map>
 #include<string>
+#include<vector>
 
-using namespace std;
+#include "bedfiles.h"
 
-struct datapoint {
+using namespace std;
 
+// midpoints of the artefacts in one replicate, for each chromosome in
+// increasing order
+typedef map<string, vector<double> > artefactlist;
+
+struct repcursor {
+  // current position in the normalized pile-up of one replicate, and the
+  // order of its chromosomes once they are needed (listed)
+  bgdreader *bgdf;
+  bgdview datapoint;
+  bool more,
+    listed;
   double mid;
-  string chrom;
-  int  start,
-    end;
+  vector<uint32_t> chroms;
+  bool comes_later(const uint32_t&) const;
+};
 
-  map<string, double> value;
-  map<string, bool> artef;
+vector<string> find_targets(const vector<string> &);
 
-};
+string pileup_file(const string &,const string &,const string &);
+
+long int clean_target(const vector<string> &,const map<string,string> &,const string &,const double &,const bool &,string &);
+
+long int find_artefacts(const vector<string> &,const double &,vector<artefactlist> &,string &);
+
+void list_chroms(const string &,repcursor &);
+
+void write_value(bgdwriter &,const double &);
+
+bool is_artefact(const artefactlist &,const bgdview &);
 
 #endif
@@ -0,0 +1,170 @@
+//***************************************************************************
+//
+// Program to write a sidecar index (file.idx) for sorted bedGraph files, so
+// that the tools can skip straight to the region around each target.
+// Optionally also saves the cumulative sums used for range queries
+// (file.psum). BGZF compressed files get a tabix index (file.tbi) instead.
+//
+//***************************************************************************
+
+#include<iostream>
+#include<cstdlib>
+#include<string>
+#include<vector>
+#include<fstream>
+#include<sstream>
+#include <sys/stat.h>
+
+#include "bedfiles.h"
+#include "bgzf.h"
+#include "tabix.h"
+#include "runreport.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<3) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./index_bdg [-i inputfile] [-f inputslist] [-s STRIDE] [-p] [--profile report]"<<endl;
+    cout<<"where       inputfile    is a bedGraph file sorted by chromosome then start (can be repeated)."<<endl;
+    cout<<"            inputslist   is a text file with a bedGraph file name in the first column of each line,"<<endl
+	<<"                         as used by the other tools."<<endl;
+    cout<<"            STRIDE       OPTIONAL: spacing in bp of the offsets stored in the index (Default=100,000)"<<endl;
+    cout<<"            -p           OPTIONAL: also save cumulative sums to file.psum (also works for binary profiles)"<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<endl;
+    cout<<"For each file an index is written to file.idx. It is used by the tools automatically, and is"<<endl;
+    cout<<"ignored if the bedGraph is changed after the index was made. BGZF compressed files (e.g. from"<<endl;
+    cout<<"find_aretfacts -z or bgzip) get a tabix index, file.tbi, instead, with which only the compressed"<<endl;
+    cout<<"blocks around each target are inflated. It is the same format as written by tabix -p bed."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vector<string> inputfiles;
+  long int stride=100000;
+  bool write_sums=false;
+  string profilefile;
+  ifstream inf;
+  string line;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-i" ) {
+      // input file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-i)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      inputfiles.push_back( string(argv[argi+1]) );
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-f" ) {
+      // input file list
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-f)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      inf.open( argv[argi+1] );
+      if ( !inf.good() ) {
+	cerr<<" ERROR : Cannot open file "<<argv[argi+1]<<endl;
+	exit(EXIT_FAILURE);
+      }
+      while ( getline(inf,line) ) {
+	istringstream sline(line);
+	string filename;
+	if ( sline>>filename ) {
+	  inputfiles.push_back( filename );
+	}
+      }
+      inf.close();
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-s" ) {
+      // stride
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-s)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      stride = atol(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-p" ) {
+      // save prefix sums
+      write_sums = true;
+      argi += 1;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  if ( !profilefile.empty() && !run_report.open(profilefile,"index_bdg",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( stride<=0 ) {
+    cerr<<"Error: STRIDE must be greater than 0"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  cout<<"Indexing "<<inputfiles.size()<<" files with a stride of "<<stride<<" bp."<<endl;
+
+  run_report.phase("index");
+  for (size_t i=0; i<inputfiles.size(); ++i) {
+    double begin = run_report.enabled() ? runreport::now() : 0.0;
+    bgdindex idx;
+    tabixindex tbi;
+    profilesums sums;
+    string error;
+    if ( is_bgzf_file(inputfiles[i]) ) {
+      if ( !tbi.build(inputfiles[i],error) ) {
+	cerr<<" Warning : Cannot index file "<<inputfiles[i]<<" ("<<error<<") skipping this."<<endl;
+	continue;
+      } else if ( !tbi.write(inputfiles[i]) ) {
+	cerr<<" Warning : Cannot write "<<inputfiles[i]+".tbi"<<" skipping this."<<endl;
+	continue;
+      }
+    } else if ( !bgdreader(inputfiles[i]).is_binary() ) {
+      if ( !idx.build(inputfiles[i],stride,error) ) {
+	cerr<<" Warning : Cannot index file "<<inputfiles[i]<<" ("<<error<<") skipping this."<<endl;
+	continue;
+      } else if ( !idx.write(inputfiles[i]) ) {
+	cerr<<" Warning : Cannot write "<<inputfiles[i]+".idx"<<" skipping this."<<endl;
+	continue;
+      }
+    }
+    if ( write_sums ) {
+      if ( !sums.build(inputfiles[i],error) ) {
+	cerr<<" Warning : Cannot find sums for file "<<inputfiles[i]<<" ("<<error<<") skipping this."<<endl;
+      } else if ( !sums.write(inputfiles[i]) ) {
+	cerr<<" Warning : Cannot write "<<inputfiles[i]+".psum"<<" skipping this."<<endl;
+      }
+    }
+    if ( run_report.enabled() ) {
+      // the whole file is read; lines are not counted
+      struct stat buffer;
+      stat(inputfiles[i].c_str(),&buffer);
+      run_report.add_file(inputfiles[i],buffer.st_size,-1,runreport::now()-begin);
+    }
+  }
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
+
+}
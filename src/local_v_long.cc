@@ -12,8 +12,15 @@
 #include<fstream>
 #include<sstream>
 #include<cmath>
+#include<vector>
+#include<algorithm>
 
+#include "local_v_long.h"
 #include "bedfiles.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
 
 using namespace std;
 
@@ -22,13 +29,17 @@ int main(int argc, char *argv[]) {
   // get options from command line
   if (argc<7) {
     cout<<"Usage :"<<endl;
-    cout<<"       ./directionality -t targetsfile -f inputslist -o outputfile [-min MIN] [-max MAX] [-h THRESH]"<<endl;
+    cout<<"       ./local_v_long -t targetsfile -f inputslist -o outputfile [-min MIN] [-max MAX] [-h THRESH | -hgrid THRESHS] [-j N] [--profile report]"<<endl;
     cout<<"where       targetsfile  is a bed file with a list of targets."<<endl;
     cout<<"            inputslist   is a text file containing a list of paths to the normalized pile-up files along with the name of the target."<<endl;
     cout<<"            outfile      is a file name for the output."<<endl;
     cout<<"            MIN          OPTIONAL: interactions closer than this (bp) are ignored (Default=1000)"<<endl;
     cout<<"            MAX          OPTIONAL: interactions further than this (bp) are ignored (Default=10,000,000)"<<endl;
     cout<<"            THRESH       OPTIONAL: cut off for where local ends and long range starts (bp) (Default=100,000)"<<endl;
+    cout<<"            THRESHS      OPTIONAL: comma separated list of cut offs (bp), all found with one read of"<<endl
+	<<"                         each file. The output then has a line for each target and cut off."<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to process targets (Default=1)"<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
     cout<<endl;
     cout<<"The inputslist file must have the following format:"<<endl;
     cout<<"         /path/to/captured_normalizedpileup_probe1.bdg        nameoftarget1"<<endl;
@@ -44,6 +55,10 @@ int main(int argc, char *argv[]) {
   double min_dist=1000,
     max_dist=10000000,
     cutoff=100000;
+  int nthreads=1;
+  vector<double> cutoffs;
+
+  string profilefile;
 
   int argi=1;
   while (argi < argc) {
@@ -102,6 +117,42 @@ int main(int argc, char *argv[]) {
       cutoff = atof(argv[argi+1]);
       argi += 2;
 
+    } else if ( string(argv[argi]) == "-hgrid" ) {
+      // list of cut offs
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-hgrid)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      istringstream slist( argv[argi+1] );
+      string item;
+      while ( getline(slist,item,',') ) {
+	char *end;
+	cutoffs.push_back( strtod(item.c_str(),&end) );
+	if ( item.empty() || *end!='\0' ) {
+	  cerr<<"Error parsing command line (-hgrid "<<item<<")"<<endl;
+	  exit(EXIT_FAILURE);
+	}
+      }
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
     } else {
       cerr<<"Error parsing command line (unrecognised option)"<<endl;
       exit(EXIT_FAILURE);
@@ -109,19 +160,38 @@ int main(int argc, char *argv[]) {
 
   }
 
+  if ( !profilefile.empty() && !run_report.open(profilefile,"local_v_long",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( nthreads < 1 ) {
+    cerr<<"Error: N must be at least 1"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  set_job_threads(nthreads);
+  bool grid = !cutoffs.empty();
+  if ( grid ) {
+    sort( cutoffs.begin(), cutoffs.end() );
+    cutoffs.erase( unique( cutoffs.begin(), cutoffs.end() ), cutoffs.end() );
+  } else {
+    cutoffs.push_back( cutoff );
+  }
+  for (size_t k=0; k<cutoffs.size(); ++k) {
+    if ( cutoffs[k]<=min_dist || cutoffs[k]>=max_dist ) {
+      cerr<<"Error: THRESH must be between MIN and MAX ("<<cutoffs[k]<<")"<<endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
   // Set up variables
   ifstream inf;
-  ofstream ouf;
   map<string,bedline> targets;
   map<string,string> inputfiles;
 
   string line;
-  double sep,
-    localCount=0.0,
-    longCount=0.0,
-    locscale,
-    lonscale;
 
+  run_report.phase("load_targets");
   // Read the targets file
   inf.open( targetsfile.c_str() );
   if ( !inf.good() ) {
@@ -135,6 +205,7 @@ int main(int argc, char *argv[]) {
   inf.close();
 
 
+  run_report.phase("load_inputslist");
   // Read the inputs list
   inf.open( inputslist.c_str() );
   if ( !inf.good() ) {
@@ -162,90 +233,87 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
   inf.close();
-  ouf.open( outputfile.c_str() );
-  ouf<<"# chrom, start, end, targetname, loc/long ratio, total local, total long"<<endl;
-  ouf<<"# Interactions with regions between "<<min_dist<<" and "<<cutoff<<" bp are local"<<endl;
-  ouf<<"# Interactions with regions between "<<cutoff<<" and "<<max_dist<<" bp are long range"<<endl;
 
   // Write messages
   cout<<"Finding local and long range reads for "<<inputfiles.size()<<" targets."<<endl;
-  cout<<"Interactions with regions between "<<min_dist<<" and "<<cutoff<<" bp are local"<<endl;
-  cout<<"Interactions with regions between "<<cutoff<<" and "<<max_dist<<" bp are long range"<<endl;
+  if ( grid ) {
+    cout<<"Using "<<cutoffs.size()<<" cut offs between local and long range"<<endl;
+  } else {
+    cout<<"Interactions with regions between "<<min_dist<<" and "<<cutoff<<" bp are local"<<endl;
+    cout<<"Interactions with regions between "<<cutoff<<" and "<<max_dist<<" bp are long range"<<endl;
+  }
 
-  // Parse input files
+  // Check the input files can be read
+  vector<string> trgnames,
+    trgfiles;
   for (map<string,string>::iterator it=inputfiles.begin();it!=inputfiles.end(); ++it) {
     inf.open( (it->second).c_str() );
     if ( !inf.good() ) {
       cerr<<" ERROR : Cannot open file "<<it->second<<" execution terminated."<<endl;
       exit(EXIT_FAILURE);
     } 
-    double actual_loc_low=1e12,
-      actual_loc_hi=0,
-      actual_lon_low=1e12,
-      actual_lon_hi=0;
-    while ( getline(inf,line) ) {
-      bgdline datapoint(line);
-      if ( targets[it->first].chrom == datapoint.chrom ) { 
-	// only consider same chrom as target
-	sep =  abs(datapoint.midpoint()-targets[it->first].midpoint());
-	if (sep>=min_dist && sep<=max_dist) {
-	  if (sep<cutoff) {
-	    // its local
-	    localCount += datapoint.value;
-	    if ( datapoint.midpoint()>targets[it->first].midpoint() ) {
-	      if ( datapoint.start-targets[it->first].midpoint()<actual_loc_low ) {
-		actual_loc_low=datapoint.start-targets[it->first].midpoint();
-	      }
-	      if ( datapoint.end-targets[it->first].midpoint()>actual_loc_hi ) {
-		actual_loc_hi=datapoint.end-targets[it->first].midpoint();
-	      }
-	    } else {
-	      if ( targets[it->first].midpoint()-datapoint.start>actual_loc_hi ) {
-		actual_loc_hi=targets[it->first].midpoint()-datapoint.start;
-	      }
-	      if ( targets[it->first].midpoint()-datapoint.end>actual_loc_low ) {
-		actual_loc_low=targets[it->first].midpoint()-datapoint.end;
-	      }
-	    }
-	  } else {
-	    // its long range
-	    longCount += datapoint.value;
-	    if ( datapoint.midpoint()>targets[it->first].midpoint() ) {
-	      if ( datapoint.start-targets[it->first].midpoint()<actual_lon_low ) {
-		actual_lon_low=datapoint.start-targets[it->first].midpoint();
-	      }
-	      if ( datapoint.end-targets[it->first].midpoint()>actual_lon_hi ) {
-		actual_lon_hi=datapoint.end-targets[it->first].midpoint();
-	      }
-	    } else {
-	      if ( targets[it->first].midpoint()-datapoint.start>actual_lon_hi ) {
-		actual_lon_hi=targets[it->first].midpoint()-datapoint.start;
-	      }
-	      if ( targets[it->first].midpoint()-datapoint.end>actual_lon_low ) {
-		actual_lon_low=targets[it->first].midpoint()-datapoint.end;
-	      }
-	    }
-	  }
-	}
+    inf.close();
+    trgnames.push_back( it->first );
+    trgfiles.push_back( it->second );
+  }
+
+  run_report.phase("compute");
+  // Parse input files, largest first when using threads
+  vector< vector<loclong> > results( trgnames.size() );
+  vector<char> readok( trgnames.size(), 1 );
+  parallel_for( largest_first(trgfiles), nthreads, [&](const size_t &i) {
+      if ( grid ) {
+	readok[i] = get_loc_long(trgfiles[i],targets.find(trgnames[i])->second,min_dist,max_dist,cutoffs,results[i]);
+      } else {
+	results[i].resize(1);
+	readok[i] = get_loc_long(trgfiles[i],targets.find(trgnames[i])->second,min_dist,max_dist,cutoff,results[i][0]);
       }
+    } );
+  for (size_t i=0; i<trgfiles.size(); ++i) {
+    // a file can still fail as it is read (a corrupt compressed file)
+    if ( !readok[i] ) {
+      cerr<<" ERROR : Cannot read file "<<trgfiles[i]<<" execution terminated."<<endl;
+      exit(EXIT_FAILURE);
     }
-    // adjustment factor to take into account different sized regions
-    locscale=(actual_loc_hi-actual_loc_low)/(cutoff-min_dist);
-    lonscale=(actual_lon_hi-actual_lon_low)/(max_dist-cutoff);
-    //cout<<locscale<<" "<<lonscale<<endl;
-
-    // output
-    ouf<<targets[it->first].chrom<<"\t"
-       <<targets[it->first].start<<"\t"
-       <<targets[it->first].end<<"\t"
-       <<it->first<<"\t"
-       <<(localCount*locscale)/(longCount*lonscale)<<"\t"
-       <<localCount*locscale<<"\t"
-       <<longCount*lonscale<<endl;
+  }
 
-    inf.close();
+  run_report.phase("write");
+  // Output in target name order. Note the counts are running totals over
+  // the targets so far.
+  if ( !write_loc_long(outputfile,targets,trgnames,min_dist,max_dist,cutoffs,grid,results) ) {
+    cerr<<" ERROR : Cannot write file "<<outputfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
   }
 
-  ouf.close();
+}
+
 
+bool get_loc_long(const string &file,bedline trg,const double &min_dist,const double &max_dist,const double &cutoff,
+		  loclong &result) {
+  // Count local and long range reads for one target. Returns false if the
+  // file cannot be read.
+  loclongmetric ll(trg,min_dist,max_dist,vector<double>(1,cutoff),false);
+  if ( !read_profile( file, trg, vector<profilemetric*>(1,&ll) ) ) {
+    return false;
+  }
+  result = ll.results()[0];
+  return true;
+}
+
+
+bool get_loc_long(const string &file,bedline trg,const double &min_dist,const double &max_dist,const vector<double> &cutoffs,
+		  vector<loclong> &results) {
+  // Count local and long range reads for a sorted list of cut offs with one
+  // read of the file (see loclongmetric). Returns false if the file cannot
+  // be read.
+  loclongmetric ll(trg,min_dist,max_dist,cutoffs,true);
+  if ( !read_profile( file, trg, vector<profilemetric*>(1,&ll) ) ) {
+    return false;
+  }
+  results = ll.results();
+  return true;
 }
@@ -0,0 +1,24 @@
+//***************************************************************************
+//
+// Header for 
+// Program to get the ratio between the number of local and long range 
+// interactions, one value per target.
+//
+//***************************************************************************
+
+#ifndef LOCVLONG_H
+#define LOCVLONG_H
+
+#include<string>
+#include<vector>
+
+#include "bedfiles.h"
+#include "metrics.h"
+
+using namespace std;
+
+bool get_loc_long(const string &,bedline,const double &,const double &,const double &,loclong &);
+
+bool get_loc_long(const string &,bedline,const double &,const double &,const vector<double> &,vector<loclong> &);
+
+#endif
@@ -12,9 +12,15 @@
 #include<fstream>
 #include<sstream>
 #include<cmath>
+#include<vector>
+#include<algorithm>
 
 #include "log_reads_v_separation.h"
 #include "bedfiles.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
 
 using namespace std;
 
@@ -23,16 +29,20 @@ int main(int argc, char *argv[]) {
   // get options from command line
   if (argc<7) {
     cout<<"Usage :"<<endl;
-    cout<<"       ./directionality -t targetsfile -f inputslist -o outputfile [-b LBW]"<<endl;
+    cout<<"       ./log_reads_v_separation -t targetsfile -f inputslist -o outputfile [-b LBW] [-j N] [--profile report]"<<endl;
     cout<<"where       targetsfile  is a bed file with a list of targets."<<endl;
     cout<<"            inputslist   is a text file containing a list of paths to the normalized pile-up files along with the name of the target."<<endl;
     cout<<"            outfile      is a file name for the output."<<endl;
     cout<<"            LBW          OPTIONAL: logarythmic bin width (Default=0.25)"<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to read files (Default 1)."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
     cout<<endl;
     cout<<"The inputslist file must have the following format:"<<endl;
     cout<<"         /path/to/captured_normalizedpileup_probe1.bdg        nameoftarget1"<<endl;
     cout<<"         /path/to/captured_normalizedpileup_probe2.bdg        nameoftarget2"<<endl;
-    cout<<"where the named target must be present in the targetsfile"<<endl;
+    cout<<"where the named target must be present in the targetsfile, or"<<endl;
+    cout<<"         /path/to/captured_normalizedpileup_probe1.bdg  nameof_condition_or_replicate   nameoftarget1"<<endl;
+    cout<<"in which case curves for each condition and each target are output as well as the average."<<endl;
     exit(EXIT_FAILURE);
   }
 
@@ -41,6 +51,9 @@ int main(int argc, char *argv[]) {
     outputfile;
 
   double log_binwidth=0.25;
+  int nthreads=1;
+
+  string profilefile;
 
   int argi=1;
   while (argi < argc) {
@@ -81,6 +94,24 @@ int main(int argc, char *argv[]) {
       log_binwidth = atof(argv[argi+1]);
       argi += 2;
 
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
     } else {
       cerr<<"Error parsing command line (unrecognised option)"<<endl;
       exit(EXIT_FAILURE);
@@ -88,21 +119,24 @@ int main(int argc, char *argv[]) {
 
   }
 
+  if ( !profilefile.empty() && !run_report.open(profilefile,"log_reads_v_separation",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  set_job_threads(nthreads);
+
   // Set up variables
   ifstream inf;
-  ofstream ouf;
   map<string,bedline> targets;
-  map<string,string> inputfiles;
+  map< pair<string,string>, string > inputfiles;   // by condition and target
+  typedef map< pair<string,string>, string >::const_iterator ifiles_it;
+  bool grouped=false;
 
   string line;
-  double bincentre,
-    actual_binwidth;
-  map<double,double> sumReads,
-    sum2Reads,
-    errorReads,
-    counterReads;
 
 
+  run_report.phase("load_targets");
   // Read the targets file
   inf.open( targetsfile.c_str() );
   if ( !inf.good() ) {
@@ -116,18 +150,35 @@ int main(int argc, char *argv[]) {
   inf.close();
 
 
-  // Read the inputs list
+  run_report.phase("load_inputslist");
+  // Read the inputs list; with three columns the second is the condition
   inf.open( inputslist.c_str() );
   if ( !inf.good() ) {
     cerr<<" ERROR : Cannot open file "<<inputslist<<endl;
     exit(EXIT_FAILURE);
   }
+  bool first=true;
   while ( getline(inf,line) ) {
     istringstream sline(line);
-    string filename,
-      trgname;
-    sline>>filename>>trgname;
-    inputfiles[trgname]=filename;
+    vector<string> fields;
+    string field;
+    while ( sline>>field ) {
+      fields.push_back(field);
+    }
+    if ( fields.size()<2 ) {
+      continue;
+    }
+    if ( first ) {
+      grouped = fields.size()>2;
+      first = false;
+    } else if ( grouped != (fields.size()>2) ) {
+      cerr<<" ERROR : All lines of the inputs list must have the same number of columns."<<endl;
+      exit(EXIT_FAILURE);
+    }
+    string filename=fields[0],
+      condname=grouped ? fields[1] : "",
+      trgname=grouped ? fields[2] : fields[1];
+    inputfiles[ make_pair(condname,trgname) ]=filename;
     if ( targets.count(trgname)==0 ) {
       cerr<<" ERROR : target "<<trgname<<" is not in the targets file."<<endl;
       exit(EXIT_FAILURE);
@@ -146,65 +197,57 @@ int main(int argc, char *argv[]) {
 
 
   // Write messages
-  cout<<"Finding reads vs genomic separation, averging over "<<inputfiles.size()<<" targets."<<endl;
+  cout<<"Finding reads vs genomic separation, averging over "<<inputfiles.size()<<(grouped ? " files." : " targets.")<<endl;
   cout<<"Using logarythmic bin width of "<<log_binwidth<<endl;
+  if ( grouped ) {
+    cout<<"Also finding curves for each condition and each target."<<endl;
+  }
 
 
-  // Parse input files
-  for (map<string,string>::iterator it=inputfiles.begin();it!=inputfiles.end(); ++it) {
-    inf.open( (it->second).c_str() );
-    if ( !inf.good() ) {
-      cerr<<" ERROR : Cannot open file "<<it->second<<" execution terminated."<<endl;
+  run_report.phase("compute");
+  // Parse input files, each into its own histogram
+  vector<string> condnames,
+    trgnames,
+    trgfiles;
+  for (ifiles_it it=inputfiles.begin();it!=inputfiles.end(); ++it) {
+    condnames.push_back( it->first.first );
+    trgnames.push_back( it->first.second );
+    trgfiles.push_back( it->second );
+  }
+  vector<loghistogram> hists( trgfiles.size(), loghistogram(log_binwidth) );
+  vector<char> readok( trgfiles.size(), 1 );
+  parallel_for( largest_first(trgfiles), nthreads, [&](const size_t &i) {
+      const bedline &trg = targets.find(trgnames[i])->second;
+      logsepmetric logsep(trg,log_binwidth);
+      readok[i] = read_profile( trgfiles[i], trg, vector<profilemetric*>(1,&logsep) );
+      hists[i] = logsep.hist;
+    } );
+
+  // Combine them in the order of the list, so the sums do not depend on threads
+  loghistogram all(log_binwidth);
+  map<string,loghistogram> bycond,
+    bytrg;
+  for (size_t i=0; i<trgfiles.size(); ++i) {
+    if ( !readok[i] ) {
+      cerr<<" ERROR : Cannot open file "<<trgfiles[i]<<" execution terminated."<<endl;
       exit(EXIT_FAILURE);
     } 
-    while ( getline(inf,line) ) {
-      bgdline datapoint(line);
-      if ( targets[it->first].chrom == datapoint.chrom ) { 
-	// only consider same chrom as target
-	// normalize by bin width
-	bincentre = get_log_bin( abs(datapoint.midpoint()-targets[it->first].midpoint()) ,log_binwidth );
-	actual_binwidth = log_bin_width(bincentre,log_binwidth);
-	sumReads[bincentre] += datapoint.value/actual_binwidth;
-	sum2Reads[bincentre] += datapoint.value*datapoint.value/actual_binwidth/actual_binwidth;
-	counterReads[bincentre] ++;
-      }
+    all.merge( hists[i] );
+    if ( grouped ) {
+      bycond.insert( make_pair(condnames[i],loghistogram(log_binwidth)) ).first->second.merge( hists[i] );
+      bytrg.insert( make_pair(trgnames[i],loghistogram(log_binwidth)) ).first->second.merge( hists[i] );
     }
-    inf.close();
-  }
-
-  // Finish averages
-  for (map<double,double>::iterator it=sumReads.begin(); it!=sumReads.end(); ++it) {
-    sumReads[it->first] /= double(counterReads[it->first]);
-    sum2Reads[it->first] /= double(counterReads[it->first]);
-    errorReads[it->first] = sqrt(sum2Reads[it->first]-sumReads[it->first]*sumReads[it->first])/sqrt(counterReads[it->first]);
   }
 
+  run_report.phase("write");
   // output
-  ouf.open( outputfile.c_str() );
-  ouf<<"# Log[bin cenre], Log[reads per kbp], standard error (log), bin centre, reads per kbp"<<endl;
-  for (map<double,double>::iterator it=sumReads.begin(); it!=sumReads.end(); ++it) {
-    ouf<<log(it->first)<<" "
-       <<log(it->second*1000)<<" "
-       <<errorReads[it->first]/it->second<<" "
-       <<it->first<<" "
-       <<it->second*1000<<" "
-       <<endl;
+  if ( !write_reads_v_separation(outputfile,all,bycond,bytrg,grouped) ) {
+    cerr<<" ERROR : Cannot write file "<<outputfile<<endl;
+    exit(EXIT_FAILURE);
   }
-  ouf.close();
-
-
-}
 
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
 
-
-double get_log_bin(const double &pos,const double &logwidth ) {
-  // convert a position to the centre of a logarythmically spaced bin
-  double logpos=log(pos);
-  return int( exp(int(logpos/logwidth)*logwidth+0.5*logwidth) );
-}
-
-double log_bin_width(const double &centre,const double &logwidth ) {
-  // From a bin centre, return the bin width in bp
-  double lcentre=log(centre);
-  return exp(lcentre+0.5*logwidth) - exp(lcentre-0.5*logwidth);
 }
@@ -12,11 +12,8 @@
 #include<string>
 
 #include "bedfiles.h"
+#include "metrics.h"
 
 using namespace std;
 
-double get_log_bin(const double &,const double &);
-
-double log_bin_width(const double &,const double &);
-
 #endif
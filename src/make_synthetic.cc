@@ -0,0 +1,321 @@
+//***************************************************************************
+//
+// Program to generate a synthetic CaptureC data set, for testing and
+// benchmarking the other tools. Reads fall off as a power of the
+// separation from each target, with a low flat background elsewhere.
+//
+//***************************************************************************
+
+#include<iostream>
+#include<cstdlib>
+#include<cmath>
+#include<string>
+#include<vector>
+#include<fstream>
+#include<sstream>
+#include<random>
+#include<algorithm>
+#include<sys/stat.h>
+
+#include "bedfiles.h"
+
+using namespace std;
+
+#define TRANS_FRACTION 0.1   // expected fraction of reads not on the target chromosome
+#define MIN_TARGET_POS 31000000 // read_stats wants targets past the first 30Mbp
+
+struct synthtarget {
+  string name;
+  int chrom;
+  long int start,
+    end;
+};
+
+vector<long int> make_fragments(const long int&,const long int&,mt19937&);
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<3) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./make_synthetic -o outdir [-b BIN] [-c NCHROM] [-l LENGTH] [-n NTARGETS] [-r NREPS]"<<endl
+	<<"                        [-a ALPHA] [-d DEPTH] [-s SEED]"<<endl;
+    cout<<"where       outdir       is a directory for the data set, which must not exist."<<endl;
+    cout<<"            BIN          is the bin size in bp, or 0 for restriction fragments of random length (Default 1000)."<<endl;
+    cout<<"            NCHROM       is the number of chromosomes (Default 3)."<<endl;
+    cout<<"            LENGTH       is the length of each chromosome in bp (Default 60,000,000)."<<endl;
+    cout<<"            NTARGETS     is the number of targets (Default 8)."<<endl;
+    cout<<"            NREPS        is the number of replicates (Default 2)."<<endl;
+    cout<<"            ALPHA        is the power of the decay of reads with separation (Default 1.0)."<<endl;
+    cout<<"            DEPTH        is the mean number of reads for each target (Default 1,000,000)."<<endl;
+    cout<<"            SEED         is the seed for the random numbers (Default 1)."<<endl;
+    cout<<endl;
+    cout<<"outdir will contain targets.bed, and for each replicate a directory rep1, rep2, ... with"<<endl;
+    cout<<"captured_rawpileup_ and captured_normalizedpileup_ files for each target. filelist.txt lists"<<endl;
+    cout<<"the normalized profiles of rep1, and filelist_withCond.txt those of all replicates, in the"<<endl;
+    cout<<"formats used by the tools. Paths are relative to outdir."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string outdir;
+  long int binsize=1000,
+    chromlength=60000000;
+  int nchrom=3,
+    ntargets=8,
+    nreps=2;
+  double alpha=1.0,
+    depth=1e6;
+  unsigned int seed=1;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-o" ) {
+      // output directory
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-o)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      outdir = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-b" ) {
+      // bin size
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-b)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      binsize = atol(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-c" ) {
+      // number of chromosomes
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-c)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nchrom = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-l" ) {
+      // chromosome length
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-l)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      chromlength = atol(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-n" ) {
+      // number of targets
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-n)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      ntargets = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-r" ) {
+      // number of replicates
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-r)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nreps = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-a" ) {
+      // power of the decay
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-a)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      alpha = atof(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-d" ) {
+      // reads per target
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-d)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      depth = atof(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-s" ) {
+      // random seed
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-s)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      seed = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  // Check parameters
+  if ( binsize<0 || nchrom<1 || chromlength<100000 || ntargets<1 || nreps<1 || alpha<=0.0 || depth<=0.0 ) {
+    cerr<<"Error: BIN must not be negative, ALPHA and DEPTH must be positive, LENGTH at least 100000,"<<endl
+	<<"       and there must be at least one chromosome, target and replicate"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( mkdir(outdir.c_str(),0777)!=0 ) {
+    cerr<<" ERROR : Cannot create directory "<<outdir<<" (it must not already exist)"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  for (int r=1; r<=nreps; ++r) {
+    stringstream repdir;
+    repdir<<outdir<<"/rep"<<r;
+    mkdir(repdir.str().c_str(),0777);
+  }
+
+  mt19937 rng(seed);
+
+  // Bins, or fragments, shared by all the profiles
+  vector<string> chroms;
+  vector< vector<long int> > edges;   // edges[c][i] is the start of fragment i
+  for (int c=1; c<=nchrom; ++c) {
+    stringstream name;
+    name<<"chr"<<c;
+    chroms.push_back( name.str() );
+    edges.push_back( make_fragments(chromlength,binsize,rng) );
+  }
+
+  // Targets, spread at random past the first 30Mbp where there is room
+  vector<synthtarget> targets;
+  long int lowest = chromlength > MIN_TARGET_POS+1000000 ? MIN_TARGET_POS : 0;
+  uniform_int_distribution<int> pick_chrom(0,nchrom-1);
+  uniform_int_distribution<long int> pick_pos(lowest,chromlength-1000);
+  for (int t=0; t<ntargets; ++t) {
+    synthtarget trg;
+    stringstream name;
+    name<<"target"<<t;
+    trg.name = name.str();
+    trg.chrom = pick_chrom(rng);
+    trg.start = pick_pos(rng);
+    trg.end = trg.start+500;
+    targets.push_back(trg);
+  }
+
+  bgdwriter ouf( outdir+"/targets.bed" );
+  for (size_t t=0; t<targets.size(); ++t) {
+    ouf<<chroms[targets[t].chrom]<<"\t"<<targets[t].start<<"\t"<<targets[t].end<<"\t"<<targets[t].name<<"\t+\n";
+  }
+  ouf.close();
+  if ( !ouf.good() ) {
+    cerr<<" ERROR : Cannot write to "<<outdir<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  bgdwriter list( outdir+"/filelist.txt" ),
+    listc( outdir+"/filelist_withCond.txt" );
+
+  // Profiles. Each fragment gets a Poisson number of reads with a mean in
+  // proportion to its width times the separation to the power -alpha on the
+  // target chromosome, and its width on the others; fragments with no reads
+  // are left out, as in a pile-up file.
+  long int total_lines=0;
+  for (size_t t=0; t<targets.size(); ++t) {
+    const synthtarget &trg = targets[t];
+    double trgmid = 0.5*(trg.start+trg.end);
+
+    // weight of each fragment
+    vector< vector<double> > weight( nchrom );
+    double cis=0.0,
+      trans=0.0;
+    for (int c=0; c<nchrom; ++c) {
+      const vector<long int> &e = edges[c];
+      weight[c].resize( e.size()-1 );
+      for (size_t i=0; i+1<e.size(); ++i) {
+	double width = e[i+1]-e[i];
+	if ( c==trg.chrom ) {
+	  double sep = fabs( 0.5*(e[i]+e[i+1])-trgmid );
+	  weight[c][i] = width*pow( sep+width, -alpha );
+	  cis += weight[c][i];
+	} else {
+	  weight[c][i] = width;
+	  trans += weight[c][i];
+	}
+      }
+    }
+    for (int c=0; c<nchrom; ++c) {
+      double scale = c==trg.chrom ? (nchrom>1 ? 1.0-TRANS_FRACTION : 1.0)*depth/cis
+	: TRANS_FRACTION*depth/trans;
+      for (size_t i=0; i<weight[c].size(); ++i) {
+	weight[c][i] *= scale;
+      }
+    }
+
+    for (int r=1; r<=nreps; ++r) {
+      // draw the reads, then normalize to reads per million
+      vector< vector<long int> > reads( nchrom );
+      long int total=0;
+      for (int c=0; c<nchrom; ++c) {
+	reads[c].resize( weight[c].size() );
+	for (size_t i=0; i<weight[c].size(); ++i) {
+	  poisson_distribution<long int> count( weight[c][i] );
+	  reads[c][i] = count(rng);
+	  total += reads[c][i];
+	}
+      }
+
+      stringstream repname,
+	rawfile,
+	normfile;
+      repname<<"rep"<<r;
+      rawfile<<repname.str()<<"/captured_rawpileup_"<<trg.name<<".bdg";
+      normfile<<repname.str()<<"/captured_normalizedpileup_"<<trg.name<<".bdg";
+
+      bgdwriter raw( outdir+"/"+rawfile.str() ),
+	norm( outdir+"/"+normfile.str() );
+      double rpm = total>0 ? 1e6/double(total) : 0.0;
+      for (int c=0; c<nchrom; ++c) {
+	const vector<long int> &e = edges[c];
+	for (size_t i=0; i<reads[c].size(); ++i) {
+	  if ( reads[c][i]>0 ) {
+	    raw<<chroms[c]<<"\t"<<e[i]<<"\t"<<e[i+1]<<"\t"<<reads[c][i]<<"\n";
+	    norm<<chroms[c]<<"\t"<<e[i]<<"\t"<<e[i+1]<<"\t"<<reads[c][i]*rpm<<"\n";
+	    ++total_lines;
+	  }
+	}
+      }
+      raw.close();
+      norm.close();
+      if ( !raw.good() || !norm.good() ) {
+	cerr<<" ERROR : Cannot write to "<<outdir<<endl;
+	exit(EXIT_FAILURE);
+      }
+
+      if ( r==1 ) {
+	list<<normfile.str()<<"\t"<<trg.name<<"\n";
+      }
+      listc<<normfile.str()<<"\t"<<repname.str()<<"\t"<<trg.name<<"\n";
+    }
+  }
+  list.close();
+  listc.close();
+
+  cout<<"Wrote "<<targets.size()*nreps<<" profiles with "<<total_lines<<" lines in total to "<<outdir<<endl;
+
+}
+
+
+vector<long int> make_fragments(const long int &length,const long int &binsize,mt19937 &rng) {
+  // Edges of the bins on a chromosome, or of restriction fragments with
+  // lengths drawn from a geometric distribution (mean about 400bp) if the bin
+  // size is 0. The last bin ends at the chromosome end.
+  vector<long int> e;
+  geometric_distribution<long int> fraglength(1.0/380.0);
+  long int pos=0;
+  while ( pos<length ) {
+    e.push_back(pos);
+    pos += binsize>0 ? binsize : 20+fraglength(rng);
+  }
+  e.push_back(length);
+  return e;
+}
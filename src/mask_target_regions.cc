@@ -0,0 +1,439 @@
+//***************************************************************************
+//
+// Program to mask target regions in capC-MAP binned and smoothed profiles
+//
+//***************************************************************************
+
+#include<iostream>
+#include<cstdlib>
+#include<cstring>
+#include<cstdio>
+#include<string>
+#include<vector>
+#include<map>
+#include<set>
+#include<fstream>
+#include<sstream>
+#include<algorithm>
+
+#include "bedfiles.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
+
+using namespace std;
+
+#define MASK_VALUE "-100"
+#define DEFAULT_EXCLUDE 500       // capC-MAP default exclusion zone
+
+struct maskregions {
+  // padded target regions on one chromosome, sorted by start, with the
+  // largest end up to each; and the same merged into disjoint intervals
+  vector< pair<long int,long int> > regions,
+    merged;
+  vector<long int> maxend;
+};
+
+// output lines of one chromosome waiting to be written, by start and then
+// the whole line, as sort -k2,2n orders them
+typedef multiset< pair<long int,string> > pendinglines;
+
+struct maskjob {
+  string infile,
+    outfile;
+  size_t masks;   // which set of regions
+};
+
+map<string,maskregions> make_masks(const vector<bedline>&,const long int&);
+bool mask_file(const string&,const string&,const map<string,maskregions>&,long int&,long int&,string&);
+bool data_chrom(const strview&,strview&);
+void write_pending(bgdwriter&,pendinglines&,const long int&);
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<7) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./mask_target_regions -c configfile -t targetsfile -d datadir [-j N] [--profile report]"<<endl;
+    cout<<"where       configfile   is the capC-MAP config file (BIN and EXCLUDE lines are used)."<<endl;
+    cout<<"            targetsfile  is the bed file of targets given to capC-MAP."<<endl;
+    cout<<"            datadir      is a directory output by capC-MAP."<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to process files (Default 1)."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<endl;
+    cout<<"For each BIN and WINDOW in the config file and each target, the profile"<<endl;
+    cout<<"         datadir/captured_bin_BIN_WINDOW_RPM_target.bdg"<<endl;
+    cout<<"is written to datadir/masked_bin_BIN_WINDOW_RPM_target.bdg with bins within max(EXCLUDE,WINDOW)"<<endl;
+    cout<<"of any target set to "<<MASK_VALUE<<"."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string configfile,
+    targetsfile,
+    datadir;
+
+  int nthreads=1;
+
+  string profilefile;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-c" ) {
+      // capC-MAP config file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-c)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      configfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-t" ) {
+      // targets file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-t)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      targetsfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-d" ) {
+      // capC-MAP output directory
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-d)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      datadir = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  if ( !profilefile.empty() && !run_report.open(profilefile,"mask_target_regions",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( nthreads < 1 ) {
+      cerr<<"Error: N must be at least 1"<<endl;
+      exit(EXIT_FAILURE);
+  }
+  set_job_threads(nthreads);
+
+  ifstream inf;
+  string line;
+
+  run_report.phase("load_config");
+  // Read the bin sizes and smoothing windows, and the exclusion zone
+  vector< pair<string,string> > binwinds;
+  long int exclude=DEFAULT_EXCLUDE;
+  inf.open( configfile.c_str() );
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<configfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  while ( getline(inf,line) ) {
+    istringstream sline(line);
+    string key,
+      v1,
+      v2;
+    sline>>key>>v1>>v2;
+    if ( key=="BIN" ) {
+      binwinds.push_back( make_pair(v1,v2) );
+    } else if ( key=="EXCLUDE" ) {
+      exclude = atol(v1.c_str());
+    }
+  }
+  inf.close();
+
+  run_report.phase("load_targets");
+  // Read the targets file
+  vector<bedline> targets;
+  inf.open( targetsfile.c_str() );
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<targetsfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  while ( getline(inf,line) ) {
+    if ( line.find_first_not_of(" \t\r")!=string::npos ) {
+      targets.push_back( bedline(line) );
+    }
+  }
+  inf.close();
+
+  // Padded regions for each window, and the files to mask with them. A
+  // file which exists already is left alone.
+  vector< map<string,maskregions> > masks;
+  vector<maskjob> jobs;
+  set<string> outfiles;
+  for (size_t bw=0; bw<binwinds.size(); ++bw) {
+    long int maskwidth = max( exclude, atol(binwinds[bw].second.c_str()) );
+    masks.push_back( make_masks(targets,maskwidth) );
+    for (size_t t=0; t<targets.size(); ++t) {
+      string name = binwinds[bw].first+"_"+binwinds[bw].second+"_RPM_"+targets[t].name+".bdg";
+      maskjob job;
+      job.infile = datadir+"/captured_bin_"+name;
+      job.outfile = datadir+"/masked_bin_"+name;
+      job.masks = bw;
+      inf.open( job.infile.c_str() );
+      bool testfile=inf.good();
+      inf.close();
+      inf.open( job.outfile.c_str() );
+      bool testout=inf.good();
+      inf.close();
+      if ( !testfile ) {
+	cerr<<" Warning : Cannot open file "<<job.infile<<" skipping this."<<endl;
+      } else if ( testout || outfiles.count(job.outfile) ) {
+	cerr<<" Warning : File "<<job.outfile<<" already exists. Will not overwrite."<<endl;
+      } else {
+	jobs.push_back(job);
+	outfiles.insert(job.outfile);
+      }
+    }
+  }
+
+  cout<<"Masking "<<jobs.size()<<" profiles for "<<targets.size()<<" targets and "
+      <<binwinds.size()<<" bin sizes."<<endl;
+
+  run_report.phase("process_files");
+  // Largest files first when using threads
+  vector<string> infiles;
+  for (size_t j=0; j<jobs.size(); ++j) {
+    infiles.push_back( jobs[j].infile );
+  }
+  vector<string> errors( jobs.size() );
+  parallel_for( largest_first(infiles), nthreads, [&](const size_t &j) {
+      double begin = runreport::now();
+      long int bytes=0,
+	lines=0;
+      if ( mask_file(jobs[j].infile,jobs[j].outfile,masks[jobs[j].masks],bytes,lines,errors[j]) ) {
+	run_report.add_file(jobs[j].infile,bytes,lines,runreport::now()-begin);
+      }
+    } );
+
+  bool good=true;
+  for (size_t j=0; j<jobs.size(); ++j) {
+    if ( !errors[j].empty() ) {
+      cerr<<" ERROR : "<<errors[j]<<endl;
+      good = false;
+    }
+  }
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
+  if ( !good ) {
+    exit(EXIT_FAILURE);
+  }
+
+}
+
+
+map<string,maskregions> make_masks(const vector<bedline> &targets,const long int &maskwidth) {
+  // Each target extended by maskwidth either side, by chromosome
+  map<string,maskregions> masks;
+  for (size_t t=0; t<targets.size(); ++t) {
+    masks[targets[t].chrom].regions.push_back( make_pair(long(targets[t].start)-maskwidth,
+							 long(targets[t].end)+maskwidth) );
+  }
+  for (map<string,maskregions>::iterator m=masks.begin(); m!=masks.end(); ++m) {
+    maskregions &r = m->second;
+    sort( r.regions.begin(), r.regions.end() );
+    long int top=LONG_MIN;
+    for (size_t i=0; i<r.regions.size(); ++i) {
+      top = max( top, r.regions[i].second );
+      r.maxend.push_back(top);
+      if ( !r.merged.empty() && r.regions[i].first<=r.merged.back().second ) {
+	r.merged.back().second = max( r.merged.back().second, r.regions[i].second );
+      } else {
+	r.merged.push_back( r.regions[i] );
+      }
+    }
+  }
+  return masks;
+}
+
+
+bool mask_file(const string &infile,const string &outfile,const map<string,maskregions> &masks,
+	       long int &bytes,long int &lines,string &error) {
+  // As the script did with bedtools: the first line if it is a header; the
+  // parts of each bin not covered by a region, with their value; and each
+  // bin once for every region it overlaps, with the value MASK_VALUE; all
+  // sorted as by sort -k1,1 -k2,2n. The chromosome blocks are found first
+  // and masked in name order. Within one the bins must be sorted by start,
+  // so a line can be written once a bin starting after it is reached, and
+  // only those which might still be passed are held back.
+  bgdreader bgdf( infile );
+  if ( !bgdf.good() ) {
+    error = "Cannot open file "+infile;
+    return false;
+  }
+  string header;
+  bool first=true;
+  strview line,
+    chrom;
+  bgdindex blocks;
+  blocks.stride = LONG_MAX;
+  chromoffsets *cur=0;
+  string curname;
+  size_t offset=bgdf.tell();
+  while ( bgdf.getline(line) ) {
+    if ( !data_chrom(line,chrom) ) {
+      if ( first ) {
+	header = line.str();
+      }
+    } else if ( cur==0 || chrom!=curname ) {
+      string name = chrom.str();
+      if ( cur!=0 ) {
+	cur->end = offset;
+      }
+      if ( blocks.chroms.count(name)!=0 ) {
+	error = "File "+infile+" does not have "+name+" in one block";
+	return false;
+      }
+      cur = &blocks.chroms[name];
+      curname = name;
+      cur->begin = offset;
+      cur->checkpoints.push_back(offset);
+    }
+    first = false;
+    offset = bgdf.tell();
+  }
+  if ( cur!=0 ) {
+    cur->end = offset;
+  }
+  if ( !bgdf.good() ) {
+    error = "Cannot read file "+infile;
+    return false;
+  }
+
+  bgdwriter ouf( outfile );
+  if ( !ouf.good() ) {
+    error = "Cannot write file "+outfile;
+    return false;
+  }
+  if ( !header.empty() ) {
+    ouf<<header<<"\n";
+  }
+  bgdview datapoint;
+  pendinglines pending;
+  for (map<string,chromoffsets>::const_iterator c=blocks.chroms.begin(); c!=blocks.chroms.end(); ++c) {
+    const string &name = c->first;
+    map<string,maskregions>::const_iterator m = masks.find(name);
+    bgdf.seek_region(blocks,name);
+    long int laststart=LONG_MIN;
+    while ( bgdf.getline(line) ) {
+      if ( !bgdf.parse(line,datapoint) ) {
+	continue;
+      }
+      ++lines;
+      long int start = datapoint.start,
+	end = datapoint.end;
+      if ( start<laststart ) {
+	error = "File "+infile+" is not sorted by start on "+name;
+	ouf.close();
+	remove( outfile.c_str() );
+	return false;
+      }
+      laststart = start;
+      // nothing still to come can start before this bin
+      write_pending(ouf,pending,start);
+      if ( m==masks.end() ) {
+	pending.insert( make_pair(start,line.str()) );
+	continue;
+      }
+      const maskregions &r = m->second;
+
+      // what is left after taking away the merged regions, which are disjoint
+      // so their ends are sorted too
+      const char *rest = datapoint.chrom.ptr+datapoint.chrom.len;
+      for (int col=0; col<2; ++col) {
+	while ( rest<line.ptr+line.len && (*rest==' ' || *rest=='\t') ) {++rest;}
+	while ( rest<line.ptr+line.len && *rest!=' ' && *rest!='\t' ) {++rest;}
+      }
+      string fields( rest, line.ptr+line.len-rest );
+      vector< pair<long int,long int> >::const_iterator g =
+	upper_bound( r.merged.begin(), r.merged.end(), make_pair(0L,start),
+		     [](const pair<long int,long int> &a,const pair<long int,long int> &b) {
+		       return a.second<b.second; } );
+      if ( g==r.merged.end() || g->first>=end ) {
+	pending.insert( make_pair(start,line.str()) );
+      } else {
+	long int from=start;
+	for ( ; g!=r.merged.end() && g->first<end; ++g ) {
+	  if ( g->first>from ) {
+	    pending.insert( make_pair(from,name+"\t"+to_string(from)+"\t"+to_string(g->first)+fields) );
+	  }
+	  from = max( from, g->second );
+	}
+	if ( from<end ) {
+	  pending.insert( make_pair(from,name+"\t"+to_string(from)+"\t"+to_string(end)+fields) );
+	}
+      }
+
+      // a masked copy for every region overlapping the bin; those which might
+      // are before the first starting at or after end, back to where the
+      // largest end so far is no longer past start
+      string masked = name+"\t"+to_string(start)+"\t"+to_string(end)+"\t"+MASK_VALUE;
+      size_t u = lower_bound( r.regions.begin(), r.regions.end(), make_pair(end,LONG_MIN) )-r.regions.begin();
+      for (size_t i=u; i>0 && r.maxend[i-1]>start; --i) {
+	if ( r.regions[i-1].second>start ) {
+	  pending.insert( make_pair(start,masked) );
+	}
+      }
+    }
+    write_pending(ouf,pending,LONG_MAX);
+  }
+  bytes = offset;
+  ouf.close();
+  if ( !ouf.good() ) {
+    error = "Cannot write file "+outfile;
+    return false;
+  }
+  return true;
+}
+
+
+bool data_chrom(const strview &line,strview &chrom) {
+  // The first field of a line, unless it is blank or a header (#, track or
+  // browser)
+  size_t i=0;
+  while ( i<line.len && (line.ptr[i]==' ' || line.ptr[i]=='\t') ) {++i;}
+  chrom.ptr = line.ptr+i;
+  while ( i<line.len && line.ptr[i]!=' ' && line.ptr[i]!='\t' && line.ptr[i]!='\r' ) {++i;}
+  chrom.len = line.ptr+i-chrom.ptr;
+  static const string track="track",
+    browser="browser";
+  return chrom.len>0 && chrom.ptr[0]!='#' && chrom!=track && chrom!=browser;
+}
+
+
+void write_pending(bgdwriter &ouf,pendinglines &pending,const long int &before) {
+  // Write the held back lines which start before a position
+  while ( !pending.empty() && pending.begin()->first<before ) {
+    ouf<<pending.begin()->second<<"\n";
+    pending.erase( pending.begin() );
+  }
+}
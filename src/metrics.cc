@@ -0,0 +1,879 @@
+//***************************************************************************
+//
+// Quantities found from the profile of a target, shared by the tools so
+// that one read of a profile can feed several of them
+//
+//***************************************************************************
+
+#include<iostream>
+#include<string>
+#include<vector>
+#include<map>
+#include<set>
+#include<fstream>
+#include<sstream>
+#include<cmath>
+#include<algorithm>
+
+#include "metrics.h"
+#include "bedfiles.h"
+#include "bigwig.h"
+#include "quantilesketch.h"
+#include "runreport.h"
+
+using namespace std;
+
+
+bool read_profile(const string &file,const bedline &trg,const vector<profilemetric*> &metrics) {
+  // Read the file once, passing each line to every metric. Only the part of
+  // the target chromosome the metrics need is read if that is all they need
+  // (or they can use the file's summaries for the rest) and the file has an
+  // index.
+  bgdreader bgdf(file);
+  if ( !bgdf.good() ) {
+    return false;
+  }
+  bool whole=false;
+  long int from=LONG_MAX,
+    to=0;
+  for (size_t m=0; m<metrics.size(); ++m) {
+    whole = whole || ( metrics[m]->whole_file() && !metrics[m]->summarize(bgdf) );
+    from = min( from, metrics[m]->from() );
+    to = max( to, metrics[m]->to() );
+  }
+  if ( !whole && !metrics.empty() ) {
+    bgdf.seek_region(trg.chrom,from,to);
+  }
+  double begin = run_report.enabled() ? runreport::now() : 0.0;
+  size_t first = bgdf.tell();
+  long int lines=0;
+  bgdview datapoint;
+  while ( bgdf.next(datapoint) ) {
+    for (size_t m=0; m<metrics.size(); ++m) {
+      metrics[m]->add(datapoint);
+    }
+    ++lines;
+  }
+  if ( !bgdf.good() ) {
+    // a compressed file is only inflated as it is read, which can fail
+    return false;
+  }
+  // summaries which the lines read show do not fit the file are dropped
+  vector<profilemetric*> again;
+  for (size_t m=0; m<metrics.size(); ++m) {
+    if ( !metrics[m]->summary_fits() ) {
+      metrics[m]->drop_summary();
+      again.push_back( metrics[m] );
+    }
+  }
+  if ( run_report.enabled() ) {
+    // for a binary file tell() does not move; count its records (start,
+    // end and value) instead
+    run_report.add_file(file, bgdf.is_binary() ? lines*long(2*sizeof(int64_t)+sizeof(double)) : long(bgdf.tell()-first),
+			lines, runreport::now()-begin);
+  }
+  if ( !again.empty() ) {
+    // those which took summaries which did not fit read the whole file
+    return read_profile(file,trg,again);
+  }
+  return true;
+}
+
+
+dirmetric::dirmetric(const bedline &trg,const vector<dirwindow> &w) :
+  chrom(trg.chromid), trgmid(0.5*(trg.start+trg.end)), total_reads(0.0), windows(w),
+  upstream(w.size(),0.0), downstream(w.size(),0.0), maxup(w.size(),0), minup(w.size(),10e9),
+  maxdown(w.size(),0), mindown(w.size(),10e9) {}
+
+void dirmetric::add(const bgdview &datapoint) {
+  size_t nw=windows.size();
+  if ( chrom != datapoint.chromid ) {
+    return;
+  }
+  for (size_t w=0; w<nw; ++w) {
+    if ( datapoint.end-trgmid>windows[w].min_dist &&
+	 datapoint.start-trgmid<windows[w].max_dist ) {
+      // downstream
+      downstream[w] += datapoint.value;
+      if (datapoint.start<mindown[w]) {mindown[w]=datapoint.start;}
+      if (datapoint.end>maxdown[w]) {maxdown[w]=datapoint.end;}
+    }
+    if ( datapoint.end-trgmid>-windows[w].max_dist &&
+	 datapoint.start-trgmid<-windows[w].min_dist ) {
+      // upstream
+      upstream[w] += datapoint.value;
+      if (datapoint.start<minup[w]) {minup[w]=datapoint.start;}
+      if (datapoint.end>maxup[w]) {maxup[w]=datapoint.end;}
+    }
+  }
+  if ( abs(datapoint.midpoint()-trgmid)<HARD_MAX &&
+       abs(datapoint.midpoint()-trgmid)>HARD_MIN ) {
+    total_reads += datapoint.value;
+  }
+}
+
+void dirmetric::add_sums(const profilesums &sums) {
+  // As add() for every line of the profile, from its cumulative sums. The
+  // windows select whole entries by their ends, which overlapping() does.
+  // Midpoints and trgmid are whole or half bp, so a midpoint below an edge
+  // is at most half a bp below it, which turns the open ranges of the total
+  // into the (from,to] ranges of midpoints().
+  const string &name = chrom_ids.name(chrom);
+  for (size_t w=0; w<windows.size(); ++w) {
+    rangesum down = sums.overlapping(name,trgmid+windows[w].min_dist,trgmid+windows[w].max_dist),
+      up = sums.overlapping(name,trgmid-windows[w].max_dist,trgmid-windows[w].min_dist);
+    if ( down.count>0 ) {
+      downstream[w] += down.sum;
+      mindown[w] = min( mindown[w], double(down.from) );
+      maxdown[w] = max( maxdown[w], double(down.to) );
+    }
+    if ( up.count>0 ) {
+      upstream[w] += up.sum;
+      minup[w] = min( minup[w], double(up.from) );
+      maxup[w] = max( maxup[w], double(up.to) );
+    }
+  }
+  total_reads += sums.midpoints(name,trgmid-HARD_MAX,trgmid-HARD_MIN-0.5).sum +
+    sums.midpoints(name,trgmid+HARD_MIN,trgmid+HARD_MAX-0.5).sum;
+}
+
+vector< pair<double,double> > dirmetric::results() const {
+  // the directionality and its error for each window
+  size_t nw=windows.size();
+  double dir;
+  int upwidth=0,
+    downwidth=0;
+  vector<double> upstream(this->upstream),
+    downstream(this->downstream);
+  vector< pair<double,double> > results;
+
+  for (size_t w=0; w<nw; ++w) {
+    // now find the log_2 ratio of the up/down stream reads per bp
+    downwidth = maxdown[w]-mindown[w];
+    upwidth = maxup[w]-minup[w];
+    upstream[w] /= double(upwidth);
+    downstream[w] /= double(downwidth);
+    dir = log(upstream[w]) - log(downstream[w]);
+
+    // now find an error
+    double p1,p2,er1,er2,erLogRat;
+    p1=upstream[w]/total_reads;
+    er1=p1*(1-p1)/sqrt(total_reads);
+    p2=downstream[w]/total_reads;
+    er2=p2*(1-p2)/sqrt(total_reads);
+    erLogRat = sqrt( (er1/upstream[w])*(er1/upstream[w]) + (er2/downstream[w])*(er2/downstream[w])  );
+
+    results.push_back( make_pair(dir,erLogRat) );
+  }
+  
+  return results;
+}
+
+
+bool write_directionality(const string &file,const map<string,bedline> &targets,const vector<string> &trgnames,
+			  const vector<dirwindow> &windows,const vector< vector< pair<double,double> > > &results,
+			  const bool &sweep) {
+  // Output in the order of trgnames; with sweep there is a line for each
+  // window
+  bgdwriter ouf( file );
+  if ( sweep ) {
+    ouf<<"# chrom, start, end, targetname, min, max, directionality, error\n";
+  } else {
+    ouf<<"# chrom, start, end, targetname, directionality, error\n";
+  }
+  for (size_t i=0; i<trgnames.size(); ++i) {
+    const bedline &trg = targets.find(trgnames[i])->second;
+    for (size_t w=0; w<windows.size(); ++w) {
+      ouf<<trg.chrom<<"\t"
+	 <<trg.start<<"\t"
+	 <<trg.end<<"\t"
+	 <<trgnames[i]<<"\t";
+      if ( sweep ) {
+	ouf<<windows[w].min_dist<<"\t"
+	   <<windows[w].max_dist<<"\t";
+      }
+      ouf<<results[i][w].first<<"\t"
+	 <<results[i][w].second<<"\n";
+    }
+  }
+
+  ouf.close();
+  return ouf.good();
+}
+
+
+loclongmetric::loclongmetric(const bedline &trg,const double &mn,const double &mx,const vector<double> &c,const bool &g) :
+  chrom(trg.chromid), trgmid(0.5*(trg.start+trg.end)), min_dist(mn), max_dist(mx), cutoffs(c), grid(g),
+  bins(c.size()+1) {}
+
+void loclongmetric::add(const bgdview &datapoint) {
+  if ( chrom != datapoint.chromid ) {
+    // only consider same chrom as target
+    return;
+  }
+  double sep =  abs(datapoint.midpoint()-trgmid);
+  if ( !grid ) {
+    double cutoff=cutoffs[0];
+    if (sep>=min_dist && sep<=max_dist) {
+      if (sep<cutoff) {
+	// its local
+	single.localCount += datapoint.value;
+	if ( datapoint.midpoint()>trgmid ) {
+	  if ( datapoint.start-trgmid<single.actual_loc_low ) {
+	    single.actual_loc_low=datapoint.start-trgmid;
+	  }
+	  if ( datapoint.end-trgmid>single.actual_loc_hi ) {
+	    single.actual_loc_hi=datapoint.end-trgmid;
+	  }
+	} else {
+	  if ( trgmid-datapoint.start>single.actual_loc_hi ) {
+	    single.actual_loc_hi=trgmid-datapoint.start;
+	  }
+	  if ( trgmid-datapoint.end>single.actual_loc_low ) {
+	    single.actual_loc_low=trgmid-datapoint.end;
+	  }
+	}
+      } else {
+	// its long range
+	single.longCount += datapoint.value;
+	if ( datapoint.midpoint()>trgmid ) {
+	  if ( datapoint.start-trgmid<single.actual_lon_low ) {
+	    single.actual_lon_low=datapoint.start-trgmid;
+	  }
+	  if ( datapoint.end-trgmid>single.actual_lon_hi ) {
+	    single.actual_lon_hi=datapoint.end-trgmid;
+	  }
+	} else {
+	  if ( trgmid-datapoint.start>single.actual_lon_hi ) {
+	    single.actual_lon_hi=trgmid-datapoint.start;
+	  }
+	  if ( trgmid-datapoint.end>single.actual_lon_low ) {
+	    single.actual_lon_low=trgmid-datapoint.end;
+	  }
+	}
+      }
+    }
+  } else if (sep>=min_dist && sep<=max_dist) {
+    size_t j;
+    // bin j has cut offs[j-1] <= sep < cut offs[j]
+    j = upper_bound(cutoffs.begin(),cutoffs.end(),sep) - cutoffs.begin();
+    sepbin &b = bins[j];
+    b.count += datapoint.value;
+    if ( datapoint.midpoint()>trgmid ) {
+      b.right_low = min( b.right_low, datapoint.start-trgmid );
+      b.hi = max( b.hi, datapoint.end-trgmid );
+    } else {
+      b.hi = max( b.hi, trgmid-datapoint.start );
+    }
+  }
+}
+
+vector<loclong> loclongmetric::results() const {
+  // the counts and extents for each cut off
+  if ( !grid ) {
+    return vector<loclong>(1,single);
+  }
+  vector<loclong> results( cutoffs.size() );
+  size_t j;
+  // local range for cut off k is bins 0 to k, long range is k+1 onwards
+  for (size_t k=0; k<cutoffs.size(); ++k) {
+    loclong &r = results[k];
+    for (j=0; j<bins.size(); ++j) {
+      if ( j<=k ) {
+	r.localCount += bins[j].count;
+	r.actual_loc_low = min( r.actual_loc_low, bins[j].right_low );
+	r.actual_loc_hi = max( r.actual_loc_hi, bins[j].hi );
+      } else {
+	r.longCount += bins[j].count;
+	r.actual_lon_low = min( r.actual_lon_low, bins[j].right_low );
+	r.actual_lon_hi = max( r.actual_lon_hi, bins[j].hi );
+      }
+    }
+  }
+  return results;
+}
+
+
+bool write_loc_long(const string &file,const map<string,bedline> &targets,const vector<string> &trgnames,
+		    const double &min_dist,const double &max_dist,const vector<double> &cutoffs,const bool &grid,
+		    const vector< vector<loclong> > &results) {
+  // Output in the order of trgnames; with grid there is a line for each cut off
+  vector<double> localCount(cutoffs.size(),0.0),
+    longCount(cutoffs.size(),0.0);
+  double locscale,
+    lonscale;
+
+  bgdwriter ouf( file );
+  if ( grid ) {
+    ouf<<"# chrom, start, end, targetname, thresh, loc/long ratio, total local, total long\n";
+    ouf<<"# Interactions with regions between "<<min_dist<<" and thresh bp are local\n";
+    ouf<<"# Interactions with regions between thresh and "<<max_dist<<" bp are long range\n";
+  } else {
+    ouf<<"# chrom, start, end, targetname, loc/long ratio, total local, total long\n";
+    ouf<<"# Interactions with regions between "<<min_dist<<" and "<<cutoffs[0]<<" bp are local\n";
+    ouf<<"# Interactions with regions between "<<cutoffs[0]<<" and "<<max_dist<<" bp are long range\n";
+  }
+
+  // Output in target name order. Note the counts are running totals over
+  // the targets so far.
+  for (size_t i=0; i<trgnames.size(); ++i) {
+    const bedline &trg = targets.find(trgnames[i])->second;
+    for (size_t k=0; k<cutoffs.size(); ++k) {
+      const loclong &r = results[i][k];
+      localCount[k] += r.localCount;
+      longCount[k] += r.longCount;
+
+      // adjustment factor to take into account different sized regions
+      locscale=(r.actual_loc_hi-r.actual_loc_low)/(cutoffs[k]-min_dist);
+      lonscale=(r.actual_lon_hi-r.actual_lon_low)/(max_dist-cutoffs[k]);
+      //cout<<locscale<<" "<<lonscale<<endl;
+
+      // output
+      ouf<<trg.chrom<<"\t"
+	 <<trg.start<<"\t"
+	 <<trg.end<<"\t"
+	 <<trgnames[i]<<"\t";
+      if ( grid ) {
+	ouf<<cutoffs[k]<<"\t";
+      }
+      ouf<<(localCount[k]*locscale)/(longCount[k]*lonscale)<<"\t"
+	 <<localCount[k]*locscale<<"\t"
+	 <<longCount[k]*lonscale<<"\n";
+    }
+  }
+
+  ouf.close();
+  return ouf.good();
+}
+
+
+logsepmetric::logsepmetric(const bedline &trg,const double &logwidth) :
+  hist(logwidth), chrom(trg.chromid), trgmid(0.5*(trg.start+trg.end)) {}
+
+void logsepmetric::add(const bgdview &datapoint) {
+  if ( chrom == datapoint.chromid ) { 
+    // only consider same chrom as target
+    hist.add( abs(datapoint.midpoint()-trgmid), datapoint.value );
+  }
+}
+
+
+bool write_reads_v_separation(const string &file,const loghistogram &all,const map<string,loghistogram> &bycond,
+			      const map<string,loghistogram> &bytrg,const bool &grouped) {
+  // when grouped, one curve after another with the first two columns saying
+  // which
+  ofstream ouf;
+  ouf.open( file.c_str() );
+  if ( grouped ) {
+    ouf<<"# curve (all, condition or target), name, Log[bin cenre], Log[reads per kbp], standard error (log), bin centre, reads per kbp"<<endl;
+    write_curve(ouf,all,"all all ");
+    for (map<string,loghistogram>::const_iterator it=bycond.begin(); it!=bycond.end(); ++it) {
+      write_curve(ouf,it->second,"condition "+it->first+" ");
+    }
+    for (map<string,loghistogram>::const_iterator it=bytrg.begin(); it!=bytrg.end(); ++it) {
+      write_curve(ouf,it->second,"target "+it->first+" ");
+    }
+  } else {
+    ouf<<"# Log[bin cenre], Log[reads per kbp], standard error (log), bin centre, reads per kbp"<<endl;
+    write_curve(ouf,all,"");
+  }
+  ouf.close();
+  return ouf.good();
+}
+
+
+void write_curve(ofstream &ouf,const loghistogram &hist,const string &label) {
+  // Finish averages and write one line per bin, each starting with label
+  map<double,logbinsums> bins = hist.bins();
+  map<double,double> sumReads,
+    sum2Reads,
+    errorReads;
+  for (map<double,logbinsums>::iterator it=bins.begin(); it!=bins.end(); ++it) {
+    sumReads[it->first] = it->second.sum/double(it->second.count);
+    sum2Reads[it->first] = it->second.sum2/double(it->second.count);
+    errorReads[it->first] = sqrt(sum2Reads[it->first]-sumReads[it->first]*sumReads[it->first])/sqrt(it->second.count);
+  }
+
+  for (map<double,double>::iterator it=sumReads.begin(); it!=sumReads.end(); ++it) {
+    ouf<<label
+       <<log(it->first)<<" "
+       <<log(it->second*1000)<<" "
+       <<errorReads[it->first]/it->second<<" "
+       <<it->first<<" "
+       <<it->second*1000<<" "
+       <<endl;
+  }
+}
+
+
+loghistogram::loghistogram(const double &lw) : logwidth(lw) {
+  // Set up bins up to 1e10 bp; any beyond are added as needed
+  extend( int(log(1e10)/logwidth)+1 );
+}
+
+void loghistogram::extend(const int &n) {
+  // Add bins up to index n, with the same centre and width as
+  // get_log_bin() and log_bin_width() give
+  for (int i=edges.size(); i<=n; ++i) {
+    edges.push_back( exp(i*logwidth) );
+    centre.push_back( int( exp(i*logwidth+0.5*logwidth) ) );
+    width.push_back( log_bin_width(centre.back(),logwidth) );
+    sums.push_back( logbinsums() );
+  }
+}
+
+int loghistogram::index(const double &pos) const {
+  // Bin index for a separation of at least 1 bp, i.e. int(log(pos)/logwidth).
+  // Positions very close to an edge are checked with log().
+  size_t i = upper_bound( edges.begin(), edges.end(), pos ) - edges.begin() - 1;
+  if ( i+1>=edges.size() || pos<edges[i]*(1.0+1e-9) || pos*(1.0+1e-9)>edges[i+1] ) {
+    return int( log(pos)/logwidth );
+  }
+  return i;
+}
+
+void loghistogram::add(const double &pos,const double &value) {
+  // Add a value at separation pos, normalized by the bin width
+  if ( !(pos>=1.0) ) {
+    // rare, so use the slow way
+    double bincentre = get_log_bin(pos,logwidth),
+      actual_binwidth = log_bin_width(bincentre,logwidth);
+    logbinsums &b = small[bincentre];
+    b.sum += value/actual_binwidth;
+    b.sum2 += value*value/actual_binwidth/actual_binwidth;
+    b.count ++;
+    return;
+  }
+  int i = index(pos);
+  if ( i>=int(sums.size()) ) {
+    extend(i);
+  }
+  logbinsums &b = sums[i];
+  b.sum += value/width[i];
+  b.sum2 += value*value/width[i]/width[i];
+  b.count ++;
+}
+
+void loghistogram::merge(const loghistogram &other) {
+  // Add the sums of another histogram with the same bin width
+  if ( other.sums.size()>sums.size() ) {
+    extend( other.sums.size()-1 );
+  }
+  for (size_t i=0; i<other.sums.size(); ++i) {
+    sums[i].sum += other.sums[i].sum;
+    sums[i].sum2 += other.sums[i].sum2;
+    sums[i].count += other.sums[i].count;
+  }
+  for (map<double,logbinsums>::const_iterator it=other.small.begin(); it!=other.small.end(); ++it) {
+    logbinsums &b = small[it->first];
+    b.sum += it->second.sum;
+    b.sum2 += it->second.sum2;
+    b.count += it->second.count;
+  }
+}
+
+map<double,logbinsums> loghistogram::bins() const {
+  // Sums for each bin centre which has entries
+  map<double,logbinsums> out(small);
+  for (size_t i=0; i<sums.size(); ++i) {
+    if ( sums[i].count>0 ) {
+      logbinsums &b = out[centre[i]];
+      b.sum += sums[i].sum;
+      b.sum2 += sums[i].sum2;
+      b.count += sums[i].count;
+    }
+  }
+  return out;
+}
+
+
+double get_log_bin(const double &pos,const double &logwidth ) {
+  // convert a position to the centre of a logarythmically spaced bin
+  double logpos=log(pos);
+  return int( exp(int(logpos/logwidth)*logwidth+0.5*logwidth) );
+}
+
+double log_bin_width(const double &centre,const double &logwidth ) {
+  // From a bin centre, return the bin width in bp
+  double lcentre=log(centre);
+  return exp(lcentre+0.5*logwidth) - exp(lcentre-0.5*logwidth);
+}
+
+
+prpnwindow::prpnwindow(const long int &f,const long int &t) : from(f), to(t) {
+  // Name used for the output file, e.g. 0to30M
+  stringstream sname;
+  if ( f%1000000==0 && t%1000000==0 ) {
+    sname<<f/1000000<<"to"<<t/1000000<<"M";
+  } else {
+    sname<<f<<"to"<<t;
+  }
+  name=sname.str();
+}
+
+bool prpnwindow::is_default() const {
+  // one of the windows read_stats uses without -w
+  vector<prpnwindow> d = default_prpn_windows();
+  for (size_t w=0; w<d.size(); ++w) {
+    if ( from==d[w].from && to==d[w].to ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<prpnwindow> default_prpn_windows() {
+  // the first 30Mb and its thirds
+  vector<prpnwindow> windows;
+  windows.push_back( prpnwindow(0,30000000) );
+  windows.push_back( prpnwindow(0,10000000) );
+  windows.push_back( prpnwindow(10000000,20000000) );
+  windows.push_back( prpnwindow(20000000,30000000) );
+  return windows;
+}
+
+
+statsmetric::statsmetric(const bedline &trg,const vector<prpnwindow> &w,const double &e) :
+  chrom(trg.chromid), windows(w), eps(e), sumWindow(w.size(),0.0), delta_x(MAXREGION), last(-1),
+  counter(0), nlow(0), nzero(0), sumTotal(0.0), sum_total(0.0), zoombases(0.0), binwidth(-1),
+  summarized(false), nosummary(false), equalbins(true), S(e) {}
+
+bool statsmetric::summarize(const bgdreader &bgdf) {
+  // Take the chromosome, window and file totals from a bigWig's zoom
+  // levels, leaving only the first 30Mbp to be read for the box plot
+  const bigwig *bw = bgdf.get_bigwig();
+  bigwigsummary s;
+  if ( nosummary || bw==0 || !bw->has_zoom() || !bw->summary(chrom_ids.name(chrom),0,MAXREGION,s) ) {
+    return false;
+  }
+  zoombases = s.bases;
+  if ( !bw->summary(chrom_ids.name(chrom),0,LONG_MAX,s) ) {
+    return false;
+  }
+  sumTotal = s.sum;
+  for (unsigned int w=0; w<windows.size(); ++w) {
+    if ( !bw->summary(chrom_ids.name(chrom),windows[w].from,windows[w].to,s) ) {
+      return false;
+    }
+    sumWindow[w] = s.sum;
+  }
+  if ( !bw->total(s) ) {
+    return false;
+  }
+  sum_total = s.sum;
+  summarized = true;
+  return true;
+}
+
+bool statsmetric::summary_fits() const {
+  // The summaries are divided by the bin size, so the bins read must all
+  // be that size and cover the bases the summaries do (to within the bin
+  // cut by the end of the region)
+  return !summarized || ( equalbins && counter>0 && binwidth==delta_x &&
+			  fabs(zoombases-double(counter)*delta_x)<=delta_x );
+}
+
+void statsmetric::drop_summary() {
+  // Start again without the summaries, for the whole file to be read
+  sumWindow.assign(windows.size(),0.0);
+  A.clear();
+  S = quantilesketch(eps);
+  delta_x = MAXREGION;
+  last = -1;
+  counter = nlow = nzero = 0;
+  sumTotal = sum_total = zoombases = 0.0;
+  binwidth = -1;
+  summarized = false;
+  nosummary = true;
+  equalbins = true;
+}
+
+void statsmetric::add(const bgdview &datapoint) {
+  long int region=MAXREGION;
+  if ( chrom == datapoint.chromid ) {
+    if ( !summarized ) {
+      sumTotal += datapoint.value;
+      for (unsigned int w=0; w<windows.size(); ++w) {
+	if ( datapoint.midpoint()>windows[w].from && datapoint.midpoint()<=windows[w].to ) {
+	  sumWindow[w] += datapoint.value;
+	}
+      }
+    }
+    if ( datapoint.midpoint()<=region ) {
+      if ( binwidth==-1 ) {
+	binwidth = datapoint.end-datapoint.start;
+      } else if ( datapoint.end-datapoint.start!=binwidth ) {
+	equalbins = false;
+      }
+      if ( eps==0.0 ) {
+	A.push_back( datapoint.value );
+      } else if ( datapoint.value==0.0 ) {
+	nzero++;
+      } else {
+	S.add( datapoint.value );
+	if ( datapoint.value<0.0 ) {
+	  nlow++;
+	}
+      }
+      counter++;
+    }
+  }
+  if (last!=-1 && datapoint.start-last<delta_x) { // find the bin size
+    delta_x = datapoint.start-last;
+  }
+  last = datapoint.start;
+  if ( !summarized ) {
+    sum_total += datapoint.value;
+  }
+}
+
+Lstats statsmetric::results(vector< pair<double,double> > &prpn) {
+  // proportion (and error) for each window, and the box plot values. The
+  // stored values are used up.
+  double p,
+    error;
+  if ( summarized ) {
+    // from bp x value to the sum over bins
+    sumTotal /= delta_x;
+    sum_total /= delta_x;
+    for (unsigned int w=0; w<windows.size(); ++w) {
+      sumWindow[w] /= delta_x;
+    }
+  }
+  prpn.resize( windows.size() );
+  for (unsigned int w=0; w<windows.size(); ++w) {
+    p = sumWindow[w]/sumTotal;
+    error = p*(1-p)/sqrt(sumTotal);
+    prpn[w] = make_pair(p,error);
+  }
+
+  if ( eps>0.0 ) {
+    return get_Lstats(S,nlow,nzero,counter,delta_x,sum_total);
+  }
+  return get_Lstats(A,counter,delta_x,sum_total);
+}
+
+
+Lstats get_Lstats(vector<double> &A,const long int &counter,const long int &delta_x,const double &sum_total) {
+  // Box plot values for the first 30Mbp, where A holds the non-empty bins
+
+  long int region=MAXREGION,
+    extra_zeros;
+
+  // Number of missing zeros
+  extra_zeros = int(double(region)/double(delta_x))-counter;
+  if ( extra_zeros<0 ) {
+    extra_zeros = 0;
+  }
+
+  // Normalize by the total number of reads
+  for (size_t i=0;i<A.size();i++) {
+    A[i]/=sum_total;
+  }
+  
+  // The values in order, zeros included
+  rankedvalues V(A,extra_zeros,0.0/sum_total);
+  return get_boxplot(V);
+
+}
+
+
+Lstats get_Lstats(const quantilesketch &S,const long int &nlow,const long int &nzero,
+		  const long int &counter,const long int &delta_x,const double &sum_total) {
+  // As above, for the approximate mode, where S holds the values which are
+  // not zero, nlow of them negative, and nzero zeros were seen
+
+  long int region=MAXREGION,
+    extra_zeros;
+
+  // Number of missing zeros
+  extra_zeros = int(double(region)/double(delta_x))-counter;
+  if ( extra_zeros<0 ) {
+    extra_zeros = 0;
+  }
+
+  sketchedvalues V(S,nlow,nzero+extra_zeros,sum_total);
+  return get_boxplot(V);
+
+}
+
+
+template<class T>
+Lstats get_boxplot(T &V) {
+  // Median, quartiles and whiskers, where V gives the values as if sorted
+  double median,
+    Q1,Q3,
+    IQR15,
+    loWisk,
+    hiWisk;
+  size_t n,j;
+  
+
+  // find median
+  if ( V.size() % 2 == 0 ) {
+    // even
+    median = 0.5*(V[ V.size()/2 -1 ] + V[ V.size()/2 ]);  // need '-1' because counting is from 0
+  } else {
+    // odd
+    median = V[ (V.size()+1)/2 -1 ];  // need '-1' because counting is from 0
+  }
+
+  // find Q1 and Q3
+  if ( V.size() % 2 == 0 ) { // even, so look at first V.size()/2 values
+    n=V.size()/2;
+  } else { // odd so look at first (V.size()+1)/2 values
+    n=(V.size()+1)/2;
+  }
+    
+  if ( n % 2 == 0 ) {
+    // even
+    Q1 = 0.5*( V[ n/2 -1 ] + V [ n/2 ] ); // need '-1' because counting is from 0
+    Q3 = 0.5*( V[ n + n/2 -1 ] + V [ n + n/2 ] ); // need '-1' because counting is from 0
+  } else {
+    // odd
+    Q1 = V[ (n+1)/2 -1 ];
+    Q3 = V[ n + (n+1)/2 -1 ];
+  }
+
+  // For the whiskers, take first and last values inside 1.5*IQR about the median
+  IQR15 = 1.5*(Q3-Q1);
+  j = V.count_below(Q1-IQR15);  // lowest value inside Q1-IQR15
+  loWisk = V[ j<V.size() ? j : V.size()-1 ];
+  j = V.count_below(Q3+IQR15);  // highest vlue inside Q3+IQR15
+  hiWisk = V[ j>0 ? j-1 : V.size()-1 ];
+
+  Lstats stats(loWisk,Q1,median,Q3,hiWisk);
+  return stats;
+  
+}
+
+
+rankedvalues::rankedvalues(vector<double> &values,const long int &zeros,const double &z) :
+  A(values), nzero(zeros), zero(z) {
+  // Drop values equal to zero, adding them to the count, and put those
+  // below zero first
+  vector<double>::iterator last = remove( A.begin(), A.end(), zero );
+  nzero += A.end()-last;
+  A.erase( last, A.end() );
+  nlow = partition( A.begin(), A.end(), [&](const double &x) { return x<zero; } ) - A.begin();
+}
+
+double rankedvalues::operator[](const size_t &k) {
+  // Value at rank k (from 0), as in the sorted list
+  if ( k<nlow ) {
+    nth_element( A.begin(), A.begin()+k, A.begin()+nlow );
+    return A[k];
+  } else if ( k<nlow+nzero ) {
+    return zero;
+  } else {
+    size_t i = k-nzero;
+    nth_element( A.begin()+nlow, A.begin()+i, A.end() );
+    return A[i];
+  }
+}
+
+size_t rankedvalues::count_below(const double &x) const {
+  // Number of values less than x
+  size_t n = zero<x ? nzero : 0;
+  for (size_t i=0; i<A.size(); ++i) {
+    if ( A[i]<x ) {
+      n++;
+    }
+  }
+  return n;
+}
+
+
+sketchedvalues::sketchedvalues(const quantilesketch &sketch,const long int &low,const long int &zeros,
+			       const double &sum_total) :
+  S(sketch), nlow(low), nzero(zeros), total(sum_total) {}
+
+double sketchedvalues::operator[](const size_t &k) const {
+  // Approximate value at rank k (from 0); the zeros are counted exactly
+  if ( k<nlow ) {
+    return S.at(k)/total;
+  } else if ( k<nlow+nzero ) {
+    return 0.0/total;
+  } else {
+    return S.at(k-nzero)/total;
+  }
+}
+
+size_t sketchedvalues::count_below(const double &x) const {
+  // Approximate number of values less than x
+  return S.count_below(x*total) + (0.0<x ? nzero : 0);
+}
+
+
+bool write_read_stats(const string &outputfilestart,const vector<prpnwindow> &windows,const set<string> &conditions,
+		      const set<string> &list_of_all_targets,map<string, map<string,Lstats> > &stats,
+		      map<string, map<string,vector< pair<double,double> > > > &prpn) {
+  // One file of proportions for each window, and one of box plot values,
+  // with a line for each target and columns for each condition
+  typedef set<string>::const_iterator cond_it;
+  typedef set<string>::const_iterator alltrg_it;
+  bgdwriter ouf;
+  bool good=true;
+  int ci;
+
+  // Ouput proportions, one file per window
+  for (unsigned int w=0; w<windows.size(); ++w) {
+    ouf.open( outputfilestart+"prpn"+windows[w].name+".dat" );
+    if ( windows[w].is_default() ) {
+      // the header the files always had, so existing parsers still work
+      ouf<<"# propotion of reads (and error) within the first 30Mb for all targets and conditions\n";
+    } else {
+      ouf<<"# propotion of reads (and error) between "<<windows[w].from<<" and "<<windows[w].to<<" bp for all targets and conditions\n";
+    }
+    ouf<<"# Column 1: name of target\n";
+    ci=2;
+    for (cond_it cond=conditions.begin(); cond!=conditions.end(); ++cond) {
+      ouf<<"# Columns "<<ci<<" and "<<ci+1<<": proportion and error for condition "<<*cond<<"\n";
+      ci+=2;
+    }
+    for (alltrg_it trg=list_of_all_targets.begin(); trg!=list_of_all_targets.end(); ++trg) {
+      ouf<<*trg;
+      for (cond_it cond=conditions.begin(); cond!=conditions.end(); ++cond) {
+	if ( prpn[*cond].find(*trg)==prpn[*cond].end() ) {
+	  // The target was not present for this condition
+	  ouf<<" "<<"0 0";
+	} else {
+	  ouf<<" "<<prpn[*cond][*trg][w].first<<" "<<prpn[*cond][*trg][w].second;
+	}
+      }
+      ouf<<"\n";
+    }
+    ouf.close();
+    good = good && ouf.good();
+  }
+
+
+  // Ouput boxplot
+  ouf.open( outputfilestart+"boxplotTo30M.dat" );
+  ouf<<"# Groups of five columns give values to draw box plots (loWhisker, Q1, median, Q3, hiWhiser)\n";
+  ouf<<"# Column 1: name of target\n";
+  ci=2;
+  for (cond_it cond=conditions.begin(); cond!=conditions.end(); ++cond) {
+    ouf<<"# Columns "<<ci<<" to "<<ci+4<<": boxplot values for condition "<<*cond<<"\n";
+    ci+=5;
+  }
+  for (alltrg_it trg=list_of_all_targets.begin(); trg!=list_of_all_targets.end(); ++trg) {
+    ouf<<*trg;
+    for (cond_it cond=conditions.begin(); cond!=conditions.end(); ++cond) {
+      if ( stats[*cond].find(*trg)==stats[*cond].end() )  {
+	// The target was not present for this condition
+	ouf<<" "<<"0 0 0 0 0";
+      } else {
+	ouf<<" "<<stats[*cond].find( *trg )->second.loWisk
+	   <<" "<<stats[*cond].find( *trg )->second.Q1
+	   <<" "<<stats[*cond].find( *trg )->second.median
+	   <<" "<<stats[*cond].find( *trg )->second.Q3
+	   <<" "<<stats[*cond].find( *trg )->second.hiWisk;
+      }
+    }
+    ouf<<"\n";
+  }
+  ouf.close();
+
+  return good && ouf.good();
+}
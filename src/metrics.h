@@ -0,0 +1,306 @@
+//***************************************************************************
+//
+// Header for
+// Quantities found from the profile of a target, shared by the tools so
+// that one read of a profile can feed several of them
+//
+//***************************************************************************
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include<string>
+#include<vector>
+#include<map>
+#include<set>
+#include<fstream>
+#include<climits>
+
+#include "bedfiles.h"
+#include "quantilesketch.h"
+
+#define HARD_MAX 10000000              // directionality: always ignore interactions further than this
+#define HARD_MIN 1000                  // directionality: always ignore interactions closer than this
+#define MAXREGION 30000000             // read_stats: box plots are for the first 30Mbp
+
+using namespace std;
+
+class profilemetric {
+  // Something found from the profile of one target. read_profile() passes
+  // each line of the file to add(), which must ignore lines it does not
+  // want. from() and to() give the part of the target chromosome which is
+  // needed, unless whole_file() says every line is. Before reading, a metric
+  // which needs the whole file is offered the reader's precomputed summaries
+  // (the zoom levels of a bigWig); if summarize() takes them, only from()
+  // to to() is read. If the lines read show the summaries do not fit the
+  // file, summary_fits() is false, and after drop_summary() the whole file
+  // is read again.
+public:
+  virtual ~profilemetric() {};
+  virtual bool whole_file() const { return false; }
+  virtual bool summarize(const bgdreader&) { return false; }
+  virtual bool summary_fits() const { return true; }
+  virtual void drop_summary() {}
+  virtual long int from() const { return 0; }
+  virtual long int to() const { return LONG_MAX; }
+  virtual void add(const bgdview&) = 0;
+};
+
+bool read_profile(const string&,const bedline&,const vector<profilemetric*>&);
+
+
+// Used by directionality
+
+struct dirwindow {
+  // distances from the target between which reads are counted
+  int min_dist,
+    max_dist;
+  dirwindow(const int &mn,const int &mx) : min_dist(mn), max_dist(mx) {};
+};
+
+class dirmetric : public profilemetric {
+  // log ratio of reads per bp upstream and downstream of the target, with
+  // an error, for a set of windows
+public:
+  dirmetric(const bedline&,const vector<dirwindow>&);
+  long int from() const { return long(trgmid)-HARD_MAX-1; }
+  long int to() const { return long(trgmid)+HARD_MAX+1; }
+  void add(const bgdview&);
+  void add_sums(const profilesums&);
+  vector< pair<double,double> > results() const;
+
+private:
+  uint32_t chrom;
+  double trgmid,
+    total_reads;
+  vector<dirwindow> windows;
+  vector<double> upstream,
+    downstream,
+    maxup,
+    minup,
+    maxdown,
+    mindown;
+};
+
+bool write_directionality(const string&,const map<string,bedline>&,const vector<string>&,
+			  const vector<dirwindow>&,const vector< vector< pair<double,double> > >&,const bool&);
+
+
+// Used by local_v_long
+
+struct loclong {
+  // reads counted for one target, and the actual extent of the regions
+  double localCount,
+    longCount,
+    actual_loc_low,
+    actual_loc_hi,
+    actual_lon_low,
+    actual_lon_hi;
+  loclong() : localCount(0.0), longCount(0.0),
+	      actual_loc_low(1e12), actual_loc_hi(0),
+	      actual_lon_low(1e12), actual_lon_hi(0) {};
+};
+
+struct sepbin {
+  // reads with separation between two consecutive cut offs
+  double count,
+    right_low,   // lowest start-trgmid to the right of the target
+    hi;          // furthest edge from the target on either side
+  sepbin() : count(0.0), right_low(1e12), hi(0) {};
+};
+
+class loclongmetric : public profilemetric {
+  // Local and long range reads for one cut off, or with grid set for a
+  // sorted list of cut offs from a histogram with the cut offs as bin edges.
+  // For a file sorted by position the extents agree with the single cut off
+  // case; the counts may differ in the last digit as they are summed in a
+  // different order.
+public:
+  loclongmetric(const bedline&,const double&,const double&,const vector<double>&,const bool&);
+  long int from() const { return long(trgmid-max_dist)-1; }
+  long int to() const { return long(trgmid+max_dist)+1; }
+  void add(const bgdview&);
+  vector<loclong> results() const;
+
+private:
+  uint32_t chrom;
+  double trgmid,
+    min_dist,
+    max_dist;
+  vector<double> cutoffs;
+  bool grid;
+  loclong single;
+  vector<sepbin> bins;
+};
+
+bool write_loc_long(const string&,const map<string,bedline>&,const vector<string>&,const double&,const double&,
+		    const vector<double>&,const bool&,const vector< vector<loclong> >&);
+
+
+// Used by log_reads_v_separation
+
+struct logbinsums {
+  // sums for one bin, of reads/width, (reads/width)^2, and number of entries
+  double sum,
+    sum2;
+  long int count;
+  logbinsums() : sum(0.0), sum2(0.0), count(0) {};
+};
+
+class loghistogram {
+  // Reads against separation in logarithmically spaced bins. A separation is
+  // mapped to a bin index with a table of bin edges rather than with log(),
+  // and sums are kept in flat arrays indexed by bin. Bins are the same as
+  // those given by get_log_bin(), where different indices can round to the
+  // same bin centre; they are combined in bins(). Histograms with the same
+  // bin width can be merged.
+public:
+  loghistogram(const double&);
+  void add(const double&,const double&);
+  void merge(const loghistogram&);
+  map<double,logbinsums> bins() const;
+
+private:
+  int index(const double&) const;
+  void extend(const int&);
+
+  double logwidth;
+  vector<double> edges,   // edges[i] is the lowest separation in bin i
+    centre,
+    width;
+  vector<logbinsums> sums;
+  map<double,logbinsums> small;  // separations below 1 bp
+};
+
+class logsepmetric : public profilemetric {
+  // reads on the target chromosome against separation from the target
+public:
+  logsepmetric(const bedline&,const double&);
+  void add(const bgdview&);
+  loghistogram hist;
+
+private:
+  uint32_t chrom;
+  double trgmid;
+};
+
+bool write_reads_v_separation(const string&,const loghistogram&,const map<string,loghistogram>&,
+			      const map<string,loghistogram>&,const bool&);
+
+void write_curve(ofstream&,const loghistogram&,const string&);
+
+double get_log_bin(const double &,const double &);
+
+double log_bin_width(const double &,const double &);
+
+
+// Used by read_stats
+
+struct Lstats {
+
+  double loWisk,
+    Q1,
+    median,
+    Q3,
+    hiWisk;
+
+  Lstats (const double &lW,const double &qq1,
+	  const double &me,const double &qq3,const double &hW) :
+    loWisk(lW), Q1(qq1), median(me), Q3(qq3), hiWisk(hW) {}
+
+};
+
+struct prpnwindow {
+  // a region of the chromosome in which to find the proportion of reads
+  long int from,
+    to;
+  string name;
+  prpnwindow(const long int &f,const long int &t);
+  bool is_default() const;
+};
+
+vector<prpnwindow> default_prpn_windows();
+
+class rankedvalues {
+  // The values for a box plot as if sorted, where the (many) values equal to
+  // zero are only counted. The others are partitioned into those below and
+  // above zero, and the value at a rank is found by selection in one part.
+public:
+  rankedvalues(vector<double>&,const long int&,const double&);
+  size_t size() const { return nzero+A.size(); }
+  double operator[](const size_t&);
+  size_t count_below(const double&) const;
+private:
+  vector<double> &A;
+  size_t nlow,
+    nzero;
+  double zero;
+};
+
+class sketchedvalues {
+  // As rankedvalues, but for the approximate mode: the values which are not
+  // zero are in a quantile sketch, and are divided by the total (which must
+  // be positive) when looked up
+public:
+  sketchedvalues(const quantilesketch&,const long int&,const long int&,const double&);
+  size_t size() const { return nzero+S.count(); }
+  double operator[](const size_t&) const;
+  size_t count_below(const double&) const;
+private:
+  const quantilesketch &S;
+  size_t nlow,
+    nzero;
+  double total;
+};
+
+class statsmetric : public profilemetric {
+  // Proportion of reads in each window, and box plot values for the first
+  // 30Mbp. If eps is set the values go into a quantile sketch rather than
+  // being stored. Needs the whole file, as values are normalized by the
+  // total over all chromosomes, unless the totals come from the zoom levels
+  // of a bigWig. Those are weighted by bases, so are divided by the bin
+  // size, which is only right for equal bins; if the first 30Mbp shows the
+  // bins are not, the whole file is read instead. Zoom sums are floats and
+  // take the bases of a window's edge bins in part, so those proportions
+  // are close to, not equal to, the ones from reading the file.
+public:
+  statsmetric(const bedline&,const vector<prpnwindow>&,const double&);
+  bool whole_file() const { return !summarized; }
+  long int from() const { return 0; }
+  long int to() const { return MAXREGION; }
+  bool summarize(const bgdreader&);
+  bool summary_fits() const;
+  void drop_summary();
+  void add(const bgdview&);
+  Lstats results(vector< pair<double,double> >&);
+
+private:
+  uint32_t chrom;
+  vector<prpnwindow> windows;
+  double eps;
+  vector<double> A,
+    sumWindow;
+  long int delta_x,
+    last,
+    counter,
+    nlow,
+    nzero;
+  double sumTotal,   // on the target chromosome
+    sum_total,       // over the whole file
+    zoombases;       // bases the summaries cover in the first 30Mbp
+  long int binwidth;
+  bool summarized,   // the sums are in bp x value, from summaries
+    nosummary,       // summaries did not fit, so are not to be used
+    equalbins;       // all bins read so far have the same width
+  quantilesketch S;
+};
+
+Lstats get_Lstats(vector<double>&,const long int&,const long int&,const double&);
+Lstats get_Lstats(const quantilesketch&,const long int&,const long int&,const long int&,const long int&,const double&);
+template<class T> Lstats get_boxplot(T&);
+
+bool write_read_stats(const string&,const vector<prpnwindow>&,const set<string>&,const set<string>&,
+		      map<string, map<string,Lstats> >&,
+		      map<string, map<string,vector< pair<double,double> > > >&);
+
+#endif
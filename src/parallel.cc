@@ -0,0 +1,66 @@
+//***************************************************************************
+//
+// Functions for spreading independent jobs across threads
+//
+//***************************************************************************
+
+#include<string>
+#include<vector>
+#include<functional>
+#include<algorithm>
+#include<thread>
+#include<atomic>
+#include <sys/stat.h>
+
+#include "parallel.h"
+
+using namespace std;
+
+
+vector<size_t> largest_first(const vector<string> &files) {
+  // Order a list of files by size, largest first, so that the longest jobs
+  // are started first. Files which cannot be found go last.
+  vector< pair<long long,size_t> > sizes;
+  struct stat buffer;
+  for (size_t i=0; i<files.size(); ++i) {
+    long long sz = -1;
+    if ( stat(files[i].c_str(),&buffer)==0 ) {
+      sz = buffer.st_size;
+    }
+    sizes.push_back( make_pair(-sz,i) );
+  }
+  stable_sort( sizes.begin(), sizes.end() );
+
+  vector<size_t> order;
+  for (size_t i=0; i<sizes.size(); ++i) {
+    order.push_back( sizes[i].second );
+  }
+  return order;
+}
+
+
+void parallel_for(const vector<size_t> &jobs,const int &nthreads,const function<void(const size_t&)> &work) {
+  // Call work(j) for every j in jobs, using nthreads workers. Jobs are handed
+  // out in the order given. With one thread everything runs on the caller.
+  if ( nthreads<=1 || jobs.size()<=1 ) {
+    for (size_t i=0; i<jobs.size(); ++i) {
+      work( jobs[i] );
+    }
+    return;
+  }
+
+  atomic<size_t> next(0);
+  vector<thread> workers;
+  int n = min( size_t(nthreads), jobs.size() );
+  for (int t=0; t<n; ++t) {
+    workers.push_back( thread( [&]() {
+	  size_t i;
+	  while ( (i=next++) < jobs.size() ) {
+	    work( jobs[i] );
+	  }
+	} ) );
+  }
+  for (int t=0; t<n; ++t) {
+    workers[t].join();
+  }
+}
@@ -0,0 +1,21 @@
+//***************************************************************************
+//
+// Header for 
+// Functions for spreading independent jobs across threads
+//
+//***************************************************************************
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include<string>
+#include<vector>
+#include<functional>
+
+using namespace std;
+
+vector<size_t> largest_first(const vector<string>&);
+
+void parallel_for(const vector<size_t>&,const int&,const function<void(const size_t&)>&);
+
+#endif
@@ -0,0 +1,506 @@
+//***************************************************************************
+//
+// Program to run several of the tools (directionality, local_v_long,
+// log_reads_v_separation and read_stats) on the same set of profiles,
+// reading each profile only once. Each writes its usual output.
+//
+//***************************************************************************
+
+#include<iostream>
+#include<cstdlib>
+#include<string>
+#include<set>
+#include<map>
+#include<vector>
+#include<fstream>
+#include<sstream>
+
+#include "bedfiles.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "bgzf.h"
+#include "runreport.h"
+
+using namespace std;
+
+struct profileresults {
+  // everything found from one profile
+  vector< pair<double,double> > dir;
+  vector<loclong> ll;
+  loghistogram hist;
+  Lstats stats;
+  vector< pair<double,double> > prpn;
+  bool readok;
+  profileresults(const double &logwidth) : hist(logwidth), stats(0,0,0,0,0), readok(true) {};
+};
+
+bool file_exists(const string &file) {
+  ifstream inf( file.c_str() );
+  return inf.good();
+}
+
+int main(int argc, char *argv[]) {
+
+  // get options from command line
+  if (argc<9) {
+    cout<<"Usage :"<<endl;
+    cout<<"       ./profile_metrics -t targetsfile -f inputslist -o outputstart -m METRICS [options] [-j N] [--profile report]"<<endl;
+    cout<<"where       targetsfile  is a bed file with a list of targets."<<endl;
+    cout<<"            inputslist   is a text file containing a list of paths to the normalized pile-up files along"<<endl
+	<<"                         with the name of the target, and optionally the name of the condition/replicate."<<endl;
+    cout<<"            outputstart  is the first part of the output file names."<<endl;
+    cout<<"            METRICS      is a comma separated list of any of"<<endl
+	<<"                         directionality, local_v_long, log_reads_v_separation, read_stats"<<endl;
+    cout<<"            N            OPTIONAL: number of threads used to process files (Default 1)."<<endl;
+    cout<<"            report       OPTIONAL: with --profile report, a JSON file of the time spent in each part of the run."<<endl;
+    cout<<"Options for each metric, with the same meaning and defaults as in that tool, are"<<endl;
+    cout<<"            directionality           -dmin MIN -dmax MAX"<<endl;
+    cout<<"            local_v_long             -lmin MIN -lmax MAX -h THRESH"<<endl;
+    cout<<"            log_reads_v_separation   -b LBW"<<endl;
+    cout<<"            read_stats               -w WINDOWS -q EPS"<<endl;
+    cout<<endl;
+    cout<<"Each profile is read once, and the output files are outputstart followed by"<<endl;
+    cout<<"directionality.dat, local_v_long.dat, log_reads_v_separation.dat, and the usual read_stats files."<<endl;
+    cout<<endl;
+    cout<<"The inputslist file must have the following format:"<<endl;
+    cout<<"         /path/to/captured_normalizedpileup_probe1.bdg        nameoftarget1"<<endl;
+    cout<<"or"<<endl;
+    cout<<"         /path/to/captured_normalizedpileup_probe1.bdg  nameof_condition_or_replicate   nameoftarget1"<<endl;
+    cout<<"where the named target must be present in the targetsfile. read_stats needs the second format. With"<<endl;
+    cout<<"the second format directionality and local_v_long write a file for each condition, named"<<endl;
+    cout<<"outputstart followed by the condition name, _, and the usual name."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string targetsfile,
+    inputslist,
+    outputfilestart;
+
+  set<string> metrics;
+  int nthreads=1,
+    dmin=3000,
+    dmax=500000;
+  double lmin=1000,
+    lmax=10000000,
+    cutoff=100000,
+    log_binwidth=0.25,
+    eps=0.0;
+  vector<prpnwindow> windows;
+
+  string profilefile;
+
+  int argi=1;
+  while (argi < argc) {
+
+    if ( string(argv[argi]) == "-t" ) {
+      // targets file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-t)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      targetsfile = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-o" ) {
+      // output file
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-o)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      outputfilestart = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-f" ) {
+      // input file list
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-f)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      inputslist = string(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-m" ) {
+      // list of metrics
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-m)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      istringstream slist( argv[argi+1] );
+      string item;
+      while ( getline(slist,item,',') ) {
+	if ( item!="directionality" && item!="local_v_long" &&
+	     item!="log_reads_v_separation" && item!="read_stats" ) {
+	  cerr<<"Error parsing command line (-m "<<item<<")"<<endl;
+	  exit(EXIT_FAILURE);
+	}
+	metrics.insert(item);
+      }
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-dmin" ) {
+      // directionality MIN
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-dmin)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      dmin = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-dmax" ) {
+      // directionality MAX
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-dmax)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      dmax = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-lmin" ) {
+      // local_v_long MIN
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-lmin)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      lmin = atof(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-lmax" ) {
+      // local_v_long MAX
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-lmax)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      lmax = atof(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-h" ) {
+      // local_v_long THRESH
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-h)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      cutoff = atof(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-b" ) {
+      // log_reads_v_separation bin width
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-b)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      log_binwidth = atof(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-w" ) {
+      // read_stats windows
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-w)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      istringstream swin( string(argv[argi+1]) );
+      string win;
+      while ( getline(swin,win,',') ) {
+	long int from,to;
+	char sep;
+	istringstream sw(win);
+	if ( !(sw>>from>>sep>>to) || sep!=':' || from>=to ) {
+	  cerr<<"Error parsing command line (-w "<<win<<")"<<endl;
+	  exit(EXIT_FAILURE);
+	}
+	windows.push_back( prpnwindow(from,to) );
+      }
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-q" ) {
+      // read_stats error bound
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-q)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      eps = atof(argv[argi+1]);
+      if ( eps<=0.0 || eps>=1.0 ) {
+        cerr<<"Error parsing command line (-q must be between 0 and 1)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "-j" ) {
+      // number of threads
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (-j)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      nthreads = atoi(argv[argi+1]);
+      argi += 2;
+
+    } else if ( string(argv[argi]) == "--profile" ) {
+      // report of the time taken
+      if (!(argi+1 < argc)) {
+        cerr<<"Error parsing command line (--profile)"<<endl;
+        exit(EXIT_FAILURE);
+      }
+      profilefile = string(argv[argi+1]);
+      argi += 2;
+
+    } else {
+      cerr<<"Error parsing command line (unrecognised option)"<<endl;
+      exit(EXIT_FAILURE);
+    }
+
+  }
+
+  if ( !profilefile.empty() && !run_report.open(profilefile,"profile_metrics",argc,argv) ) {
+    cerr<<" ERROR : File "<<profilefile<<" already exists. Will not overwrite."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  bool do_dir = metrics.count("directionality")>0,
+    do_ll = metrics.count("local_v_long")>0,
+    do_logsep = metrics.count("log_reads_v_separation")>0,
+    do_stats = metrics.count("read_stats")>0;
+
+  // Check parameters, as the separate tools do
+  if ( metrics.empty() ) {
+    cerr<<"Error: no metrics given (-m)"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( do_dir && (dmin<HARD_MIN || dmax>HARD_MAX || dmin>=dmax) ) {
+    cerr<<"Error: directionality MIN and MAX must have "<<HARD_MIN<<" <= MIN < MAX <= "<<HARD_MAX<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( do_ll && (cutoff<=lmin || cutoff>=lmax) ) {
+    cerr<<"Error: THRESH must be between MIN and MAX ("<<cutoff<<")"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  if ( nthreads < 1 ) {
+    cerr<<"Error: N must be at least 1"<<endl;
+    exit(EXIT_FAILURE);
+  }
+  set_job_threads(nthreads);
+  if ( windows.empty() ) {
+    windows = default_prpn_windows();
+  }
+  vector<dirwindow> dirwindows( 1, dirwindow(dmin,dmax) );
+  vector<double> cutoffs( 1, cutoff );
+
+  // Set up variables
+  ifstream inf;
+  map<string,bedline> targets;
+  map< pair<string,string>, string > inputfiles;   // by condition and target
+  typedef map< pair<string,string>, string >::const_iterator ifiles_it;
+  set<string> conditions,
+    list_of_all_targets;
+  bool grouped=false,
+    first=true;
+
+  string line;
+
+  run_report.phase("load_targets");
+  // Read the targets file
+  inf.open( targetsfile.c_str() );
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<targetsfile<<endl;
+    exit(EXIT_FAILURE);
+  }
+  while ( getline(inf,line) ) {
+    bedline newtrg(line);
+    targets[newtrg.name]=newtrg;
+  }
+  inf.close();
+
+  run_report.phase("load_inputslist");
+  // Read the inputs list; with three columns the second is the condition
+  inf.open( inputslist.c_str() );
+  if ( !inf.good() ) {
+    cerr<<" ERROR : Cannot open file "<<inputslist<<endl;
+    exit(EXIT_FAILURE);
+  }
+  while ( getline(inf,line) ) {
+    istringstream sline(line);
+    vector<string> fields;
+    string field;
+    while ( sline>>field ) {
+      fields.push_back(field);
+    }
+    if ( fields.size()<2 ) {
+      continue;
+    }
+    if ( first ) {
+      grouped = fields.size()>2;
+      first = false;
+    } else if ( grouped != (fields.size()>2) ) {
+      cerr<<" ERROR : All lines of the inputs list must have the same number of columns."<<endl;
+      exit(EXIT_FAILURE);
+    }
+    string filename=fields[0],
+      condname=grouped ? fields[1] : "",
+      trgname=grouped ? fields[2] : fields[1];
+    inputfiles[ make_pair(condname,trgname) ]=filename;
+    conditions.insert( condname );
+    list_of_all_targets.insert( trgname );
+    if ( targets.count(trgname)==0 ) {
+      cerr<<" ERROR : target "<<trgname<<" is not in the targets file."<<endl;
+      exit(EXIT_FAILURE);
+    }
+    if ( do_stats && targets[trgname].start < MAXREGION ) {
+      cerr<<" WARNING : target "<<trgname<<" is within the first 30Mb of the chromosome. Results will not make sense."<<endl;
+    }
+  }
+  inf.close();
+  if ( do_stats && !grouped ) {
+    cerr<<" ERROR : read_stats needs an inputs list with the condition in the second column."<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Output file names, and check they do not exist
+  vector<string> outfiles;
+  for (set<string>::const_iterator cond=conditions.begin(); cond!=conditions.end(); ++cond) {
+    string start = grouped ? outputfilestart+*cond+"_" : outputfilestart;
+    if ( do_dir ) {
+      outfiles.push_back( start+"directionality.dat" );
+    }
+    if ( do_ll ) {
+      outfiles.push_back( start+"local_v_long.dat" );
+    }
+  }
+  if ( do_logsep ) {
+    outfiles.push_back( outputfilestart+"log_reads_v_separation.dat" );
+  }
+  if ( do_stats ) {
+    for (unsigned int w=0; w<windows.size(); ++w) {
+      outfiles.push_back( outputfilestart+"prpn"+windows[w].name+".dat" );
+    }
+    outfiles.push_back( outputfilestart+"boxplotTo30M.dat" );
+  }
+  for (size_t i=0; i<outfiles.size(); ++i) {
+    if ( file_exists(outfiles[i]) ) {
+      cerr<<" ERROR : File "<<outfiles[i]<<" already exists. Will not overwrite."<<endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Write messages
+  cout<<"Finding "<<metrics.size()<<" metrics for "<<inputfiles.size()<<" profiles:";
+  for (set<string>::const_iterator it=metrics.begin(); it!=metrics.end(); ++it) {
+    cout<<" "<<*it;
+  }
+  cout<<endl;
+
+  run_report.phase("compute");
+  // Read each profile once, passing every line to all the metrics, largest
+  // files first when using threads
+  vector<string> condnames,
+    trgnames,
+    trgfiles;
+  for (ifiles_it it=inputfiles.begin(); it!=inputfiles.end(); ++it) {
+    condnames.push_back( it->first.first );
+    trgnames.push_back( it->first.second );
+    trgfiles.push_back( it->second );
+  }
+  vector<profileresults> results( trgfiles.size(), profileresults(log_binwidth) );
+  parallel_for( largest_first(trgfiles), nthreads, [&](const size_t &i) {
+      const bedline &trg = targets.find(trgnames[i])->second;
+      dirmetric dir(trg,dirwindows);
+      loclongmetric ll(trg,lmin,lmax,cutoffs,false);
+      logsepmetric logsep(trg,log_binwidth);
+      statsmetric stats(trg,windows,eps);
+      vector<profilemetric*> wanted;
+      if ( do_dir ) {
+	wanted.push_back( &dir );
+      }
+      if ( do_ll ) {
+	wanted.push_back( &ll );
+      }
+      if ( do_logsep ) {
+	wanted.push_back( &logsep );
+      }
+      if ( do_stats ) {
+	wanted.push_back( &stats );
+      }
+      profileresults &r = results[i];
+      r.readok = read_profile( trgfiles[i], trg, wanted );
+      if ( do_dir ) {
+	r.dir = dir.results();
+      }
+      if ( do_ll ) {
+	r.ll = ll.results();
+      }
+      if ( do_logsep ) {
+	r.hist = logsep.hist;
+      }
+      if ( do_stats ) {
+	r.stats = stats.results( r.prpn );
+      }
+    } );
+  // As in directionality, a file which cannot be read is left out of the
+  // per-target outputs; the combined log_reads_v_separation and read_stats
+  // outputs would be wrong without it, so then the run stops as those
+  // tools do
+  for (size_t i=0; i<trgfiles.size(); ++i) {
+    if ( !results[i].readok && (do_logsep || do_stats) ) {
+      cerr<<" ERROR : Cannot open file "<<trgfiles[i]<<" execution terminated."<<endl;
+      exit(EXIT_FAILURE);
+    } else if ( !results[i].readok ) {
+      cerr<<" Warning : Cannot open file "<<trgfiles[i]<<" skipping this."<<endl;
+    }
+  }
+
+  run_report.phase("write");
+  // directionality and local_v_long, for each condition in target name order
+  bool good=true;
+  for (set<string>::const_iterator cond=conditions.begin(); cond!=conditions.end(); ++cond) {
+    string start = grouped ? outputfilestart+*cond+"_" : outputfilestart;
+    vector<string> names;
+    vector< vector< pair<double,double> > > dirs;
+    vector< vector<loclong> > lls;
+    for (size_t i=0; i<trgfiles.size(); ++i) {
+      if ( condnames[i]==*cond && results[i].readok ) {
+	names.push_back( trgnames[i] );
+	dirs.push_back( results[i].dir );
+	lls.push_back( results[i].ll );
+      }
+    }
+    if ( do_dir ) {
+      good = write_directionality(start+"directionality.dat",targets,names,dirwindows,dirs,false) && good;
+    }
+    if ( do_ll ) {
+      good = write_loc_long(start+"local_v_long.dat",targets,names,lmin,lmax,cutoffs,false,lls) && good;
+    }
+  }
+
+  // log_reads_v_separation, combined in the order of the list
+  if ( do_logsep ) {
+    loghistogram all(log_binwidth);
+    map<string,loghistogram> bycond,
+      bytrg;
+    for (size_t i=0; i<trgfiles.size(); ++i) {
+      all.merge( results[i].hist );
+      if ( grouped ) {
+	bycond.insert( make_pair(condnames[i],loghistogram(log_binwidth)) ).first->second.merge( results[i].hist );
+	bytrg.insert( make_pair(trgnames[i],loghistogram(log_binwidth)) ).first->second.merge( results[i].hist );
+      }
+    }
+    good = write_reads_v_separation(outputfilestart+"log_reads_v_separation.dat",all,bycond,bytrg,grouped) && good;
+  }
+
+  // read_stats
+  if ( do_stats ) {
+    map<string, map<string,vector< pair<double,double> > > > prpn;
+    map<string, map<string,Lstats> > stats;
+    for (size_t i=0; i<trgfiles.size(); ++i) {
+      stats[condnames[i]].insert( pair<string,Lstats>( trgnames[i],results[i].stats ) );
+      prpn[condnames[i]][trgnames[i]] = results[i].prpn;
+    }
+    good = write_read_stats(outputfilestart,windows,conditions,list_of_all_targets,stats,prpn) && good;
+  }
+
+  if ( !good ) {
+    cerr<<" ERROR : Could not write all the output files"<<endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if ( !run_report.write() ) {
+    cerr<<" WARNING : Cannot write file "<<profilefile<<endl;
+  }
+
+}
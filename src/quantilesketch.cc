@@ -0,0 +1,149 @@
+//***************************************************************************
+//
+// Approximate quantiles of a stream of values in fixed memory
+//
+//***************************************************************************
+
+#include<vector>
+#include<algorithm>
+#include<cmath>
+#include<random>
+
+#include "quantilesketch.h"
+
+using namespace std;
+
+
+quantilesketch::quantilesketch(const double &eps) : n(0), nitems(0), levels(1), rng(5489u), sorted(false) {
+  // Size of the top compactor for a rank error eps (with 99% confidence),
+  // from the usual empirical fit eps = 2.296/k^0.9375
+  double e = eps>0.0 ? eps : 0.01;
+  k = size_t( ceil( pow(2.296/e, 1.0/0.9375) ) );
+  if ( k<8 ) {
+    k = 8;
+  }
+  limit = total_capacity();
+}
+
+size_t quantilesketch::capacity(const size_t &h) const {
+  // Levels shrink by 2/3 going down from the top, to no fewer than 8 items
+  size_t depth = levels.size()-1-h;
+  size_t c = size_t( ceil( k*pow(2.0/3.0,double(depth)) ) );
+  return c<8 ? 8 : c;
+}
+
+size_t quantilesketch::total_capacity() const {
+  size_t c=0;
+  for (size_t h=0; h<levels.size(); ++h) {
+    c += capacity(h);
+  }
+  return c;
+}
+
+void quantilesketch::add(const double &x) {
+  levels[0].push_back(x);
+  n++;
+  nitems++;
+  sorted = false;
+  if ( nitems>=limit ) {
+    compress();
+  }
+}
+
+void quantilesketch::compress() {
+  // Compact the lowest level which is over capacity, until the sketch fits
+  while ( nitems>=limit ) {
+    size_t h=0;
+    while ( levels[h].size()<capacity(h) ) {
+      h++;
+    }
+    if ( h+1==levels.size() ) {
+      levels.push_back( vector<double>() );
+      limit = total_capacity();
+    }
+    vector<double> &lev = levels[h];
+    sort( lev.begin(), lev.end() );
+    // an odd item out stays behind
+    double keep = 0.0;
+    bool odd = lev.size()%2==1;
+    if ( odd ) {
+      keep = lev.back();
+      lev.pop_back();
+    }
+    size_t offset = rng()%2;
+    for (size_t i=offset; i<lev.size(); i+=2) {
+      levels[h+1].push_back( lev[i] );
+    }
+    nitems -= lev.size()/2;
+    lev.clear();
+    if ( odd ) {
+      lev.push_back(keep);
+    }
+  }
+}
+
+void quantilesketch::merge(const quantilesketch &other) {
+  // Add the items of another sketch, level by level
+  while ( levels.size()<other.levels.size() ) {
+    levels.push_back( vector<double>() );
+  }
+  limit = total_capacity();
+  for (size_t h=0; h<other.levels.size(); ++h) {
+    levels[h].insert( levels[h].end(), other.levels[h].begin(), other.levels[h].end() );
+  }
+  n += other.n;
+  nitems += other.nitems;
+  sorted = false;
+  compress();
+}
+
+void quantilesketch::sort_items() const {
+  // All items in order, with the running total of their weights
+  if ( sorted ) {
+    return;
+  }
+  vector< pair<double,size_t> > items;
+  for (size_t h=0; h<levels.size(); ++h) {
+    for (size_t i=0; i<levels[h].size(); ++i) {
+      items.push_back( make_pair(levels[h][i],size_t(1)<<h) );
+    }
+  }
+  sort( items.begin(), items.end() );
+  size_t w=0;
+  for (size_t i=0; i<items.size(); ++i) {
+    w += items[i].second;
+    items[i].second = w;
+  }
+  weighted.swap(items);
+  sorted = true;
+}
+
+static bool weight_below(const size_t &w,const pair<double,size_t> &item) {
+  return w<item.second;
+}
+
+double quantilesketch::at(const size_t &rank) const {
+  // Approximate value at rank (from 0) in the sorted stream; compacting
+  // keeps the total weight equal to the number of values added
+  sort_items();
+  if ( weighted.empty() ) {
+    return 0.0;
+  }
+  vector< pair<double,size_t> >::const_iterator it =
+    upper_bound( weighted.begin(), weighted.end(), rank, weight_below );
+  if ( it==weighted.end() ) {
+    return weighted.back().first;
+  }
+  return it->first;
+}
+
+size_t quantilesketch::count_below(const double &x) const {
+  // Approximate number of values less than x
+  sort_items();
+  vector< pair<double,size_t> >::const_iterator it =
+    lower_bound( weighted.begin(), weighted.end(), make_pair(x,size_t(0)) );
+  if ( it==weighted.begin() ) {
+    return 0;
+  }
+  return (it-1)->second;
+}
@@ -0,0 +1,49 @@
+//***************************************************************************
+//
+// Header for 
+// Approximate quantiles of a stream of values in fixed memory
+//
+//***************************************************************************
+
+#ifndef QUANTILESKETCH_H
+#define QUANTILESKETCH_H
+
+#include<vector>
+#include<random>
+#include<cstddef>
+
+using namespace std;
+
+class quantilesketch {
+  // KLL sketch: values are kept in a stack of compactors, where level h
+  // holds items standing for 2^h values each. When the sketch is full a
+  // level is sorted and every other item (at a random offset) promoted, so
+  // the number of items kept depends only on the error bound. Ranks are
+  // within about eps*count of the true ones. Sketches of parts of a stream
+  // can be merged.
+public:
+  quantilesketch(const double &eps=0.01);
+  void add(const double&);
+  void merge(const quantilesketch&);
+  size_t count() const { return n; }
+  size_t items() const { return nitems; }
+  double at(const size_t&) const;
+  size_t count_below(const double&) const;
+
+private:
+  size_t capacity(const size_t&) const;
+  size_t total_capacity() const;
+  void compress();
+  void sort_items() const;
+
+  size_t k,
+    n,
+    nitems,
+    limit;    // compact when nitems reaches this
+  vector< vector<double> > levels;
+  mt19937 rng;
+  mutable bool sorted;
+  mutable vector< pair<double,size_t> > weighted;   // (value, cumulative weight)
+};
+
+#endif
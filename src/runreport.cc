@@ -0,0 +1,243 @@
+//***************************************************************************
+//
+// Timing report for a run of a tool, written as JSON with --profile
+//
+//***************************************************************************
+
+#include<string>
+#include<vector>
+#include<fstream>
+#include<cstring>
+#include<cstdio>
+#include<algorithm>
+#include<ctime>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+
+#include "runreport.h"
+
+using namespace std;
+
+
+runreport run_report;
+
+static const char *counter_names[NCOUNTERS] = {"cycles","instructions","cache_misses"};
+
+
+runreport::runreport() : on(false), have_counters(false) {
+  for (int c=0; c<NCOUNTERS; ++c) {
+    fds[c] = -1;
+  }
+}
+
+runreport::~runreport() {
+  for (int c=0; c<NCOUNTERS; ++c) {
+    if ( fds[c]>=0 ) {
+      ::close(fds[c]);
+    }
+  }
+}
+
+bool runreport::open(const string &file,const string &name,const int &argc,char *argv[]) {
+  // Start the report, to be written to file (which must not exist). The
+  // hardware counters are left out if any of them cannot be opened, e.g.
+  // because of perf_event_paranoid or in a container.
+  ifstream inf( file.c_str() );
+  if ( inf.good() ) {
+    return false;
+  }
+  filename = file;
+  tool = name;
+  for (int i=0; i<argc; ++i) {
+    command += (i>0 ? " " : "")+string(argv[i]);
+  }
+
+  unsigned long long int config[NCOUNTERS] = {PERF_COUNT_HW_CPU_CYCLES,
+					      PERF_COUNT_HW_INSTRUCTIONS,
+					      PERF_COUNT_HW_CACHE_MISSES};
+  have_counters = true;
+  for (int c=0; c<NCOUNTERS; ++c) {
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config[c];
+    attr.inherit = 1;          // count threads started later
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fds[c] = syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+    if ( fds[c]<0 ) {
+      have_counters = false;
+    }
+  }
+  if ( !have_counters ) {
+    for (int c=0; c<NCOUNTERS; ++c) {
+      if ( fds[c]>=0 ) {
+	::close(fds[c]);
+	fds[c] = -1;
+      }
+    }
+  }
+
+  on = true;
+  started = read_sample();
+  return true;
+}
+
+double runreport::now() {
+  // wall clock time in seconds
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+runreport::sample runreport::read_sample() const {
+  sample s;
+  s.wall = now();
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+  s.cpu = ts.tv_sec+1e-9*ts.tv_nsec;
+  for (int c=0; c<NCOUNTERS; ++c) {
+    s.counters[c] = 0;
+    if ( have_counters && read(fds[c],&s.counters[c],sizeof(long long int))!=sizeof(long long int) ) {
+      s.counters[c] = -1;
+    }
+  }
+  return s;
+}
+
+void runreport::end_phase() {
+  // add the time since the current phase started to it
+  if ( current.empty() ) {
+    return;
+  }
+  sample s = read_sample();
+  phaseinfo p;
+  p.name = current;
+  p.taken.wall = s.wall-phase_start.wall;
+  p.taken.cpu = s.cpu-phase_start.cpu;
+  for (int c=0; c<NCOUNTERS; ++c) {
+    p.taken.counters[c] = s.counters[c]-phase_start.counters[c];
+  }
+  phases.push_back(p);
+  current.clear();
+}
+
+void runreport::phase(const string &name) {
+  if ( !on ) {
+    return;
+  }
+  end_phase();
+  current = name;
+  phase_start = read_sample();
+}
+
+void runreport::add_file(const string &name,const long int &bytes,const long int &lines,const double &seconds) {
+  if ( !on ) {
+    return;
+  }
+  fileinfo f;
+  f.name = name;
+  f.bytes = bytes;
+  f.lines = lines;
+  f.seconds = seconds;
+  lock_guard<mutex> guard(lock);
+  files.push_back(f);
+}
+
+static string json_string(const string &s) {
+  // s quoted, with the characters JSON does not allow escaped
+  string out="\"";
+  for (size_t i=0; i<s.size(); ++i) {
+    if ( s[i]=='"' || s[i]=='\\' ) {
+      out += '\\';
+      out += s[i];
+    } else if ( (unsigned char)s[i]<0x20 ) {
+      char esc[8];
+      snprintf(esc,sizeof(esc),"\\u%04x",(unsigned char)s[i]);
+      out += esc;
+    } else {
+      out += s[i];
+    }
+  }
+  return out+"\"";
+}
+
+static void write_counters(ofstream &ouf,const long long int *counters,const bool &have) {
+  for (int c=0; c<NCOUNTERS; ++c) {
+    ouf<<", "<<json_string(counter_names[c])<<": ";
+    if ( have && counters[c]>=0 ) {
+      ouf<<counters[c];
+    } else {
+      ouf<<"null";
+    }
+  }
+}
+
+bool runreport::write() {
+  // End the last phase and write the report
+  if ( !on ) {
+    return true;
+  }
+  end_phase();
+  sample s = read_sample();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+  long int bytes=0,
+    lines=0;
+  double file_seconds=0.0;
+  for (size_t f=0; f<files.size(); ++f) {
+    bytes += files[f].bytes;
+    lines += max( files[f].lines, 0L );
+    file_seconds += files[f].seconds;
+  }
+
+  ofstream ouf( filename.c_str() );
+  ouf.precision(9);
+  ouf<<"{"<<endl;
+  ouf<<"  \"tool\": "<<json_string(tool)<<","<<endl;
+  ouf<<"  \"command\": "<<json_string(command)<<","<<endl;
+  ouf<<"  \"wall_seconds\": "<<s.wall-started.wall<<","<<endl;
+  ouf<<"  \"cpu_seconds\": "<<s.cpu-started.cpu<<","<<endl;
+  ouf<<"  \"peak_rss_kb\": "<<usage.ru_maxrss<<","<<endl;
+  ouf<<"  \"bytes\": "<<bytes<<","<<endl;
+  ouf<<"  \"lines\": "<<lines<<","<<endl;
+  ouf<<"  \"file_seconds\": "<<file_seconds<<","<<endl;
+  ouf<<"  \"hardware_counters\": "<<(have_counters ? "true" : "false");
+  long long int total[NCOUNTERS];
+  for (int c=0; c<NCOUNTERS; ++c) {
+    total[c] = s.counters[c]-started.counters[c];
+  }
+  write_counters(ouf,total,have_counters);
+  ouf<<","<<endl;
+  ouf<<"  \"phases\": ["<<endl;
+  for (size_t p=0; p<phases.size(); ++p) {
+    ouf<<"    {\"name\": "<<json_string(phases[p].name)
+       <<", \"wall_seconds\": "<<phases[p].taken.wall
+       <<", \"cpu_seconds\": "<<phases[p].taken.cpu;
+    write_counters(ouf,phases[p].taken.counters,have_counters);
+    ouf<<"}"<<(p+1<phases.size() ? "," : "")<<endl;
+  }
+  ouf<<"  ],"<<endl;
+  ouf<<"  \"files\": ["<<endl;
+  for (size_t f=0; f<files.size(); ++f) {
+    ouf<<"    {\"name\": "<<json_string(files[f].name)
+       <<", \"bytes\": "<<files[f].bytes
+       <<", \"lines\": ";
+    if ( files[f].lines>=0 ) {
+      ouf<<files[f].lines;
+    } else {
+      ouf<<"null";
+    }
+    ouf<<", \"seconds\": "<<files[f].seconds<<"}"
+       <<(f+1<files.size() ? "," : "")<<endl;
+  }
+  ouf<<"  ]"<<endl;
+  ouf<<"}"<<endl;
+  ouf.close();
+  return ouf.good();
+}
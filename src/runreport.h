@@ -0,0 +1,76 @@
+//***************************************************************************
+//
+// Header for
+// Timing report for a run of a tool, written as JSON with --profile
+//
+//***************************************************************************
+
+#ifndef RUNREPORT_H
+#define RUNREPORT_H
+
+#include<string>
+#include<vector>
+#include<mutex>
+
+using namespace std;
+
+#define NCOUNTERS 3    // cycles, instructions, cache misses
+
+class runreport {
+  // Wall and CPU time, and hardware counters where perf_event_open allows,
+  // for each phase of a run (phase() ends the last one and starts the next),
+  // plus the bytes and lines read from each input file and the peak RSS.
+  // Until open() is called every method does nothing, so the calls can be
+  // left in the tools. add_file() may be called from any thread. The
+  // counters include threads which have finished by the end of a phase.
+  // A file's lines may be given as -1 if they are not counted.
+public:
+  runreport();
+  ~runreport();
+  bool open(const string&,const string&,const int&,char *[]);
+  bool enabled() const { return on; }
+  void phase(const string&);
+  void add_file(const string&,const long int&,const long int&,const double&);
+  bool write();
+  static double now();
+
+private:
+  runreport(const runreport&);
+  runreport& operator=(const runreport&);
+
+  struct sample {
+    double wall,
+      cpu;
+    long long int counters[NCOUNTERS];
+  };
+  struct phaseinfo {
+    string name;
+    sample taken;
+  };
+  struct fileinfo {
+    string name;
+    long int bytes,
+      lines;
+    double seconds;
+  };
+
+  sample read_sample() const;
+  void end_phase();
+
+  bool on,
+    have_counters;
+  string filename,
+    tool,
+    command;
+  int fds[NCOUNTERS];
+  sample started,
+    phase_start;
+  string current;
+  vector<phaseinfo> phases;
+  vector<fileinfo> files;
+  mutex lock;
+};
+
+extern runreport run_report;
+
+#endif
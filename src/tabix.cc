@@ -0,0 +1,397 @@
+//***************************************************************************
+//
+// Tabix (.tbi) indexes of BGZF compressed bedGraph files
+//
+//***************************************************************************
+
+#include<string>
+#include<vector>
+#include<map>
+#include<fstream>
+#include<iterator>
+#include<algorithm>
+#include<cstring>
+#include<stdint.h>
+#include <sys/stat.h>
+
+#include "tabix.h"
+#include "bedfiles.h"
+#include "bgzf.h"
+
+using namespace std;
+
+
+#define TBI_WINDOW_SHIFT 14      // linear index windows of 16kb
+#define TBI_MAX_COORD (1L<<29)   // the binning scheme covers 512Mb
+#define TBI_UNSET UINT64_MAX
+
+static uint32_t reg2bin(const long int &beg,long int end) {
+  // smallest bin holding [beg,end)
+  --end;
+  if (beg>>14 == end>>14) return ((1<<15)-1)/7 + (beg>>14);
+  if (beg>>17 == end>>17) return ((1<<12)-1)/7 + (beg>>17);
+  if (beg>>20 == end>>20) return ((1<<9)-1)/7 + (beg>>20);
+  if (beg>>23 == end>>23) return ((1<<6)-1)/7 + (beg>>23);
+  if (beg>>26 == end>>26) return ((1<<3)-1)/7 + (beg>>26);
+  return 0;
+}
+
+static void reg2bins(const long int &beg,long int end,vector<uint32_t> &bins) {
+  // all bins which may hold lines overlapping [beg,end)
+  const int shift[5] = {26,23,20,17,14},
+    first[5] = {1,9,73,585,4681};
+  --end;
+  bins.assign(1,0);
+  for (int level=0; level<5; ++level) {
+    for (long int k=first[level]+(beg>>shift[level]); k<=first[level]+(end>>shift[level]); ++k) {
+      bins.push_back(k);
+    }
+  }
+}
+
+static void put(vector<char> &out,uint64_t v,const int &bytes) {
+  // little endian, as in the format
+  for (int i=0; i<bytes; ++i) {
+    out.push_back( char(v & 0xff) );
+    v >>= 8;
+  }
+}
+
+static bool get(const string &in,size_t &pos,uint64_t &v,const int &bytes) {
+  if ( pos+bytes>in.size() ) {
+    return false;
+  }
+  v = 0;
+  for (int i=bytes-1; i>=0; --i) {
+    v = (v<<8) | (unsigned char)in[pos+i];
+  }
+  pos += bytes;
+  return true;
+}
+
+
+bool tabixindex::build(const string &file,string &error) {
+  // Index a BGZF bedGraph, which must be sorted by chromosome then start.
+  // Offsets in the inflated text are turned into virtual offsets using the
+  // block layout, which is found from the block headers alone.
+  ifstream inf( file.c_str(), ios::binary );
+  string raw( (istreambuf_iterator<char>(inf)), istreambuf_iterator<char>() );
+  vector<bgzfblock> blocks;
+  if ( !bgzf_blocks(raw.data(),raw.size(),0,raw.size(),blocks) || blocks.empty() ) {
+    error = "not a BGZF file";
+    return false;
+  }
+  bgdreader bgdf(file);
+  if ( !bgdf.good() || bgdf.is_binary() ) {
+    error = "cannot read as a text bedGraph";
+    return false;
+  }
+  names.clear();
+  refs.clear();
+  skip = 0;
+
+  auto voffset = [&](const size_t &u) -> uint64_t {
+    // the block holding offset u, or the next one if u is at the end of one
+    size_t b = upper_bound( blocks.begin(), blocks.end(), u,
+			    [](const size_t &x,const bgzfblock &blk) { return x<blk.out; } )-blocks.begin()-1;
+    while ( u-blocks[b].out>=blocks[b].outlen && b+1<blocks.size() ) {
+      b++;
+    }
+    if ( u-blocks[b].out>=blocks[b].outlen && blocks[b].outlen>0 ) {
+      return uint64_t(raw.size())<<16;
+    }
+    return (uint64_t(blocks[b].start)<<16) | (u-blocks[b].out);
+  };
+
+  strview line;
+  bgdview v;
+  bool seen_data=false,
+    open=false;
+  string last;
+  long int laststart=0;
+  uint32_t curbin=0;
+  tabixchunk chunk;
+  size_t offset=bgdf.tell();
+  while ( bgdf.getline(line) ) {
+    size_t next_offset = bgdf.tell();
+    if ( !bgdf.parse(line,v) ) {
+      if ( !seen_data ) {
+	skip++;
+      }
+      offset = next_offset;
+      continue;
+    }
+    seen_data = true;
+    if ( refs.empty() || v.chrom!=last ) {
+      if ( open ) {
+	refs.back().bins[curbin].push_back(chunk);
+	open = false;
+      }
+      last = v.chrom.str();
+      if ( find(names.begin(),names.end(),last)!=names.end() ) {
+	error = "chromosome "+last+" is not in one block, file is not sorted";
+	return false;
+      }
+      names.push_back(last);
+      refs.push_back( tabixref() );
+      laststart = v.start;
+    }
+    if ( v.start<laststart ) {
+      error = "file is not sorted by start on "+last;
+      return false;
+    }
+    laststart = v.start;
+    long int beg = max( v.start, 0L ),
+      end = v.end>beg ? v.end : beg+1;
+    if ( end>TBI_MAX_COORD ) {
+      error = "coordinates beyond 512Mb on "+last+" cannot be indexed";
+      return false;
+    }
+
+    tabixref &ref = refs.back();
+    uint64_t vbeg = voffset(offset),
+      vend = voffset(next_offset);
+    uint32_t bin = reg2bin(beg,end);
+    if ( open && bin==curbin ) {
+      chunk.end = vend;
+    } else {
+      if ( open ) {
+	ref.bins[curbin].push_back(chunk);
+      }
+      curbin = bin;
+      chunk.beg = vbeg;
+      chunk.end = vend;
+      open = true;
+    }
+    size_t lastwin = (end-1)>>TBI_WINDOW_SHIFT;
+    if ( ref.linear.size()<=lastwin ) {
+      ref.linear.resize(lastwin+1,TBI_UNSET);
+    }
+    for (size_t w=beg>>TBI_WINDOW_SHIFT; w<=lastwin; ++w) {
+      if ( ref.linear[w]==TBI_UNSET ) {
+	ref.linear[w] = vbeg;
+      }
+    }
+    offset = next_offset;
+  }
+  if ( !bgdf.good() ) {
+    error = "cannot decompress file";
+    return false;
+  }
+  if ( open ) {
+    refs.back().bins[curbin].push_back(chunk);
+  }
+
+  // windows with no lines start where the window before does
+  for (size_t r=0; r<refs.size(); ++r) {
+    uint64_t prev=0;
+    for (size_t w=0; w<refs[r].linear.size(); ++w) {
+      if ( refs[r].linear[w]==TBI_UNSET ) {
+	refs[r].linear[w] = prev;
+      }
+      prev = refs[r].linear[w];
+    }
+  }
+  return true;
+}
+
+bool tabixindex::write(const string &file) const {
+  // Write file.tbi, itself BGZF compressed
+  vector<char> out,
+    zipped;
+  out.insert( out.end(), "TBI\1", "TBI\1"+4 );
+  put(out,names.size(),4);
+  put(out,0x10000,4);     // generic format, 0-based half open coordinates
+  put(out,1,4);           // chromosome, start and end columns
+  put(out,2,4);
+  put(out,3,4);
+  put(out,'#',4);         // comment lines
+  put(out,skip,4);
+  size_t l_nm=0;
+  for (size_t r=0; r<names.size(); ++r) {
+    l_nm += names[r].size()+1;
+  }
+  put(out,l_nm,4);
+  for (size_t r=0; r<names.size(); ++r) {
+    out.insert( out.end(), names[r].c_str(), names[r].c_str()+names[r].size()+1 );
+  }
+  for (size_t r=0; r<refs.size(); ++r) {
+    put(out,refs[r].bins.size(),4);
+    for (map<uint32_t,vector<tabixchunk> >::const_iterator b=refs[r].bins.begin(); b!=refs[r].bins.end(); ++b) {
+      put(out,b->first,4);
+      put(out,b->second.size(),4);
+      for (size_t c=0; c<b->second.size(); ++c) {
+	put(out,b->second[c].beg,8);
+	put(out,b->second[c].end,8);
+      }
+    }
+    put(out,refs[r].linear.size(),4);
+    for (size_t w=0; w<refs[r].linear.size(); ++w) {
+      put(out,refs[r].linear[w],8);
+    }
+  }
+
+  bgzfdeflate zip;
+  if ( !zip.compress(out.data(),out.size(),zipped) ) {
+    return false;
+  }
+  bgzfdeflate::eof(zipped);
+  ofstream ouf( (file+".tbi").c_str(), ios::binary );
+  ouf.write( zipped.data(), zipped.size() );
+  ouf.close();
+  return ouf.good();
+}
+
+bool tabixindex::load(const string &file) {
+  // Load file.tbi, returns false if there is none, it is older than the
+  // file or it is not a bedGraph index
+  struct stat sb,
+    ib;
+  string tbi = file+".tbi";
+  if ( stat(file.c_str(),&sb)!=0 || stat(tbi.c_str(),&ib)!=0 || ib.st_mtime<sb.st_mtime ) {
+    return false;
+  }
+  ifstream inf( tbi.c_str(), ios::binary );
+  string raw( (istreambuf_iterator<char>(inf)), istreambuf_iterator<char>() ),
+    in,
+    error;
+  if ( !gunzip(raw.data(),raw.size(),in,error) ||
+       in.size()<36 || in.compare(0,4,"TBI\1")!=0 ) {
+    return false;
+  }
+  size_t pos=4;
+  uint64_t n_ref,
+    format,
+    col[3],
+    meta,
+    nskip,
+    l_nm;
+  if ( !get(in,pos,n_ref,4) || !get(in,pos,format,4) || !get(in,pos,col[0],4) ||
+       !get(in,pos,col[1],4) || !get(in,pos,col[2],4) || !get(in,pos,meta,4) ||
+       !get(in,pos,nskip,4) || !get(in,pos,l_nm,4) || pos+l_nm>in.size() ) {
+    return false;
+  }
+  // the lines must be read the way they were indexed
+  if ( (format&0xffff)!=0 || col[0]!=1 || col[1]!=2 || col[2]!=3 ) {
+    return false;
+  }
+  skip = nskip;
+  names.clear();
+  refs.assign(n_ref,tabixref());
+  for (size_t p=pos; p<pos+l_nm; ) {
+    size_t len = strnlen(in.data()+p,pos+l_nm-p);
+    names.push_back( in.substr(p,len) );
+    p += len+1;
+  }
+  pos += l_nm;
+  if ( names.size()!=n_ref ) {
+    return false;
+  }
+  for (size_t r=0; r<n_ref; ++r) {
+    uint64_t n_bin,
+      n_intv;
+    if ( !get(in,pos,n_bin,4) ) {
+      return false;
+    }
+    for (uint64_t b=0; b<n_bin; ++b) {
+      uint64_t bin,
+	n_chunk;
+      if ( !get(in,pos,bin,4) || !get(in,pos,n_chunk,4) || pos+16*n_chunk>in.size() ) {
+	return false;
+      }
+      vector<tabixchunk> &chunks = refs[r].bins[bin];
+      chunks.resize(n_chunk);
+      for (uint64_t c=0; c<n_chunk; ++c) {
+	get(in,pos,chunks[c].beg,8);
+	get(in,pos,chunks[c].end,8);
+      }
+    }
+    if ( !get(in,pos,n_intv,4) || pos+8*n_intv>in.size() ) {
+      return false;
+    }
+    refs[r].linear.resize(n_intv);
+    for (uint64_t w=0; w<n_intv; ++w) {
+      get(in,pos,refs[r].linear[w],8);
+    }
+  }
+  return true;
+}
+
+vector<tabixchunk> tabixindex::query(const string &chrom,const long int &from,const long int &to) const {
+  // Chunks which may hold lines overlapping [from,to], sorted and merged
+  // where they share a block so that no block is inflated twice
+  vector<tabixchunk> found;
+  size_t r = find(names.begin(),names.end(),chrom)-names.begin();
+  if ( r==names.size() ) {
+    return found;
+  }
+  const tabixref &ref = refs[r];
+  long int beg = min( max(from,0L), TBI_MAX_COORD-1 ),
+    end = to<TBI_MAX_COORD ? max(to+1,beg+1) : TBI_MAX_COORD;
+  uint64_t min_off=0;
+  if ( !ref.linear.empty() ) {
+    min_off = ref.linear[ min( size_t(beg>>TBI_WINDOW_SHIFT), ref.linear.size()-1 ) ];
+  }
+
+  vector<uint32_t> bins;
+  reg2bins(beg,end,bins);
+  for (size_t b=0; b<bins.size(); ++b) {
+    map<uint32_t,vector<tabixchunk> >::const_iterator it = ref.bins.find(bins[b]);
+    if ( it==ref.bins.end() ) {
+      continue;
+    }
+    for (size_t c=0; c<it->second.size(); ++c) {
+      if ( it->second[c].end>min_off ) {
+	found.push_back(it->second[c]);
+      }
+    }
+  }
+  sort(found.begin(),found.end());
+
+  vector<tabixchunk> merged;
+  for (size_t c=0; c<found.size(); ++c) {
+    if ( !merged.empty() && (found[c].beg>>16)<=(merged.back().end>>16) ) {
+      merged.back().end = max( merged.back().end, found[c].end );
+    } else {
+      merged.push_back(found[c]);
+    }
+  }
+  return merged;
+}
+
+bool tabixindex::read_region(const char *data,const size_t &size,const string &chrom,
+			     const long int &from,const long int &to,string &out,string &error) const {
+  // Put the text of the lines which may overlap [from,to] on chrom in out,
+  // given the whole compressed file. Lines between chunks which share a
+  // block are included too, so callers still have to test each line.
+  out.clear();
+  vector<tabixchunk> chunks = query(chrom,from,to);
+  vector<bgzfblock> blocks;
+  string text;
+  for (size_t c=0; c<chunks.size(); ++c) {
+    size_t first = chunks[c].beg>>16,
+      last = chunks[c].end>>16,
+      upto = (chunks[c].end&0xffff) ? last : last-1;
+    // a chunk ending at the start of a block needs nothing from it; the
+    // blocks found must reach the end of the chunk, or the file is cut short
+    if ( !bgzf_blocks(data,size,first,upto,blocks) || blocks.empty() ||
+	 blocks.back().in+blocks.back().inlen+8<=upto ||
+	 !bgzf_inflate(data,blocks,text,error) ) {
+      if ( error.empty() ) {
+	error = "index does not match the file";
+      }
+      return false;
+    }
+    size_t begin = chunks[c].beg&0xffff,
+      end = text.size();
+    for (size_t b=0; b<blocks.size(); ++b) {
+      if ( blocks[b].start==last ) {
+	end = min( end, size_t(blocks[b].out+(chunks[c].end&0xffff)) );
+      }
+    }
+    if ( begin<end ) {
+      out.append(text,begin,end-begin);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,49 @@
+//***************************************************************************
+//
+// Header for
+// Tabix (.tbi) indexes of BGZF compressed bedGraph files
+//
+//***************************************************************************
+
+#ifndef TABIX_H
+#define TABIX_H
+
+#include<string>
+#include<vector>
+#include<map>
+#include<stdint.h>
+
+using namespace std;
+
+struct tabixchunk {
+  // range of virtual offsets, (block file offset<<16)|offset in the block
+  uint64_t beg,
+    end;
+  bool operator<(const tabixchunk &c) const { return beg<c.beg; }
+};
+
+
+struct tabixref {
+  // bins of the UCSC binning scheme with their chunks, and the offset of the
+  // first line overlapping each 16kb window
+  map<uint32_t,vector<tabixchunk> > bins;
+  vector<uint64_t> linear;
+};
+
+
+struct tabixindex {
+  // Index (file.tbi) for a BGZF bedGraph sorted by chromosome then start, in
+  // the format written by tabix -p bed, so either can read the other's. The
+  // index is ignored if it is older than the file. read_region() inflates
+  // only the blocks which may hold lines overlapping a region.
+  vector<string> names;
+  vector<tabixref> refs;
+  int32_t skip;    // leading header lines
+  bool build(const string&,string&);
+  bool write(const string&) const;
+  bool load(const string&);
+  vector<tabixchunk> query(const string&,const long int&,const long int&) const;
+  bool read_region(const char*,const size_t&,const string&,const long int&,const long int&,string&,string&) const;
+};
+
+#endif